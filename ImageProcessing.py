@@ -222,7 +222,7 @@ class populateRasterQueueThread(threading.Thread):
 class dealWithImageThread(threading.Thread):
     # Used in place of basic edge detect,
     #   This does raster image processing
-    def __init__(self, q, pq, mode, ser, size):
+    def __init__(self, q, pq, mode, ser, size, send=0):
 	threading.Thread.__init__(self)
 	self.name = "ImageEverything"
 	self.daemon = True
@@ -231,9 +231,10 @@ class dealWithImageThread(threading.Thread):
 	self.pq = pq
 	self.ser = ser
 	self.size = size
+	self.send = send
     def run(self):
 	self.pq.put(("M", "Image Processing Begining"))
-	runImageSide(self.mode, self.q, self.pq, self.ser, self.size)
+	runImageSide(self.mode, self.q, self.pq, self.ser, self.size, self.send)
     def stop(self):
 	self._stop.set()
     def stopped(self):
@@ -273,12 +274,17 @@ class printQueueThread(threading.Thread):
     def stopped(self):
 	return self._stop.isSet()
 
-def runImageSide(mode, q, pq, ser, size):
+def runImageSide(mode, q, pq, ser, size, send=0):
     while True:
 	# Take Picture
 	myImg = takePic()
 	#myImg = "KandS2Float.png"
 	size = 100 #240  #**********
+	if (send != 0):
+	    # Sent as a job: no startIm / endIm, the MSP only takes a job
+	    #   when it has no picture going
+	    runJobSide(mode, pq, ser, myImg, size, send)
+	    continue
 	# Start Image command
 	response = 2
 	rpSerial.sendX(ser, chr(startX))
@@ -299,6 +305,9 @@ def runImageSide(mode, q, pq, ser, size):
 	    thresholdLevels = getThresh(myA)
 	    threadPop = rasterQ(myA, q, thresholdLevels, pq)
 	    print "THREAD POP"
+	elif (mode == 2):
+	    myA = rasterImage(myImg, size)
+	    threadPop = ditherQ(myA, q, pq)
    	#time.sleep(.05)
 	# Wait for all of the image to be done being processed
 	while q.qsize() > 0:
@@ -314,6 +323,25 @@ def runImageSide(mode, q, pq, ser, size):
 	    response = rpSerial.receiveX(ser, [chr(0x02), chr(0x06), chr(0x0F), chr(0x03)])
     return
 
+def runJobSide(mode, pq, ser, myImg, size, send):
+    # Uploads the whole picture to the MSP's flash and has it burn it from
+    #   there (rpSerial.rpJobManager), instead of streaming it pixel by pixel
+    jobQ = Queue.Queue()
+    myA = rasterImage(myImg, size)
+    if (send == 2):
+	# Compressed raster job, decoded by the MSP as it burns
+	image = rasterJob(myA, getThresh(myA), pq)
+	result = rpSerial.rpJobManager(jobQ, ser, image, rpSerial.JOB_FORMAT_RASTER)
+    else:
+	if (mode == 2):
+	    ditherQ(myA, jobQ, pq, False)
+	else:
+	    rasterQ(myA, jobQ, getThresh(myA), pq, False)
+	result = rpSerial.rpJobManager(jobQ, ser)
+    if (result != 0):
+	pq.put(("M", "Job not burned"))
+    return
+
 def getLevel(pixel, levels):
     # takes a pixel input, and returns the laser intensity
     value = len(levels)
@@ -377,13 +405,38 @@ End	0x03
     #print format(payload, '02x')
     return payload
 
+def buildDitherPayload(gray, xLoc, yLoc):
+    # gray: 		4 bits (0 - 15), dithered into sub-dots by the MSP
+    # xLoc: 		13 bits
+    # yLoc: 		13 bits
+    # ditherFlag:	1 bit (bit 31)
+    # Same layout as buildpayload, with the gray value widened into
+    #   the unused bits above the laser value
+    payload = 0x00000000
+    grayMask = 15
+    xMask = 8191
+    yMask = 8191
+    gray = gray & grayMask
+    xLoc = xLoc & xMask
+    yLoc = yLoc & yMask
+
+    payload = payload | 1
+    payload = payload << 4
+    payload = payload | gray
+    payload = payload << 13
+    payload = payload | xLoc
+    payload = payload << 13
+    payload = payload | yLoc
+    payload = payload << 1
+    return payload
+
 def rasterMode(q, printq):
     # Go to take Pic fun, wait for Image to be armed
     # And for user to push button
     myImg = takePic()
 
 
-def rasterQ(imagA, q, levels, printq):
+def rasterQ(imagA, q, levels, printq, wait=True):
     msg = ("M", "Running RASTER")
     printq.put(msg)
     xSize = len(imagA[0])
@@ -429,7 +482,138 @@ def rasterQ(imagA, q, levels, printq):
     msg = ("M", "Done Processing Image: Queue fully populated")
     printq.put(msg)
     Qdone = True
-    while not q.empty():
+    # Unless it's for a job, wait for the serial thread to send it all
+    while wait and not q.empty():
+	time.sleep(1)
+
+    return
+
+def rasterJob(imagA, levels, printq):
+    # Builds a JOB_FORMAT_RASTER job image (for rpSerial.rpJobManager) of the
+    #   same burns rasterQ queues: each pixel is a 2-bit symbol, packed 4 to
+    #   a byte in burn order and compressed with lzPack. The MSP decodes it
+    #   as it burns - see job.c for the format
+    xSize = len(imagA[0])
+    ySize = len(imagA)
+    # getLevel gives 0 (blank) to len(levels), but only 4 symbols fit in
+    #   2 bits - fold the least used burn value into its neighbour
+    counts = [0] * (len(levels) + 1)
+    for j in range(ySize):
+	for i in range(xSize):
+	    counts[getLevel(imagA[j][i], levels)] += 1
+    merged = range(len(levels) + 1)
+    used = [v for v in range(1, len(counts)) if counts[v] > 0]
+    while len(used) > 3:
+	rare = min(used, key=lambda v: counts[v])
+	k = used.index(rare)
+	into = used[k - 1] if k > 0 else used[1]
+	printq.put(("M", "Raster job: level " + str(rare - 1) + " burned as " + str(into - 1)))
+	counts[into] += counts[rare]
+	for v in range(len(merged)):
+	    if merged[v] == rare:
+		merged[v] = into
+	used.remove(rare)
+    # Symbol 0 is blank, the burn values left take 1 - 3
+    symLevel = [0xFF] + [v - 1 for v in used] + [0xFF] * (3 - len(used))
+    valueSym = [used.index(merged[v]) + 1 if merged[v] in used else 0 for v in range(len(merged))]
+
+    # Each of the MSP's lines (one y) is an image column, as rasterQ burns them
+    packed = []
+    byte = 0
+    n = 0
+    for i in range(xSize):
+	for j in range(ySize):
+	    if (i % 2 == 0):
+		pixel = imagA[j][i]
+	    else:
+		pixel = imagA[ySize - j - 1][i]
+	    byte = byte | (valueSym[getLevel(pixel, levels)] << (2 * n))
+	    n += 1
+	    if (n == 4):
+		packed.append(byte)
+		byte = 0
+		n = 0
+    if (n > 0):
+	packed.append(byte)
+
+    header = [ySize & 0xFF, ySize >> 8, xSize & 0xFF, xSize >> 8, 0, 0, 0, 0] + symLevel
+    image = header + lzPack(packed)
+    msg = ("M", "Raster job: " + str(len(packed)) + " bytes packed, " + str(len(image)) + " compressed")
+    printq.put(msg)
+    return image
+
+def lzPack(data):
+    # Compresses bytes for the MSP's raster decoder. Tokens:
+    #   0x00 - 0x7F: the next token + 1 bytes, as they are
+    #   0x80 - 0xBF: the next byte, (token & 0x3F) + 3 times
+    #   0xC0 - 0xFF: (token & 0x3F) + 3 bytes copied from (next byte + 1) back
+    out = []
+    literal = []
+    recent = {}		# Last few places each 3 bytes were seen
+    pos = 0
+    while pos < len(data):
+	longest = min(66, len(data) - pos)
+	run = 1
+	while run < longest and data[pos + run] == data[pos]:
+	    run += 1
+	match = 0
+	distance = 0
+	key = tuple(data[pos:pos + 3])
+	for start in recent.get(key, []):
+	    if pos - start > 256:
+		continue
+	    length = 0
+	    while length < longest and data[start + length] == data[pos + length]:
+		length += 1
+	    if length > match:
+		match = length
+		distance = pos - start
+	if run >= 3 or match >= 3:
+	    while len(literal) > 0:
+		out += [len(literal[:128]) - 1] + literal[:128]
+		literal = literal[128:]
+	    if run >= match:
+		out += [0x80 | (run - 3), data[pos]]
+		length = run
+	    else:
+		out += [0xC0 | (match - 3), distance - 1]
+		length = match
+	else:
+	    literal.append(data[pos])
+	    length = 1
+	for p in range(pos, pos + length):
+	    k = tuple(data[p:p + 3])
+	    recent[k] = ([p] + recent.get(k, []))[:8]
+	pos += length
+    while len(literal) > 0:
+	out += [len(literal[:128]) - 1] + literal[:128]
+	literal = literal[128:]
+    return out
+
+def ditherQ(imagA, q, printq, wait=True):
+    # Like rasterQ, but each pixel is sent as a 4 bit gray value and
+    #   the MSP renders it as a pattern of sub-dots, so the image can
+    #   be sent at a lower resolution
+    msg = ("M", "Running DITHER")
+    printq.put(msg)
+    xSize = len(imagA[0])
+    ySize = len(imagA)
+    leftToRight = True
+    for i in range(xSize):
+	for j in range(ySize):
+	    if (leftToRight == True):
+		yLoc = j
+	    else:
+		yLoc = ySize - j - 1
+	    gray = int(imagA[yLoc][i]) >> 4
+	    if (gray > 0): #skip all blank areas
+		# Same axes as rasterQ: the image column is the MSP's y
+		payload = buildDitherPayload(gray, yLoc, i)
+		q.put(payload)
+	leftToRight = not leftToRight
+    msg = ("M", "Done Processing Image: Queue fully populated")
+    printq.put(msg)
+    while wait and not q.empty():
 	time.sleep(1)
 
     return
@@ -675,6 +859,11 @@ def main():
     # Function defaults:
     raster = 0
     edgeDetect = 1
+    dither = 2
+    # Ways to send the picture:
+    streamed = 0	# Pixel by pixel as it burns (rpSerialManager)
+    flashJob = 1	# Uploaded to the MSP's flash first (rpJobManager)
+    flashRaster = 2	# Same, compressed (rasterJob - raster levels only)
     q = Queue.Queue() # Pixel queue
     pq = Queue.Queue() #print queue
 
@@ -684,6 +873,7 @@ def main():
     #thresholdLevels = [75, 110, 180, 225]
     #myImg = "template.png"
     mode = raster
+    send = streamed
     #   Set Serial Ports
     myBaud = 115200
     myTimeO = 1
@@ -730,7 +920,7 @@ def main():
     # Start all threads: Printing thread, Serail com thread, and Edge or Raster Thread
     printThread = printQueueThread(pq, "h")
     threadSerial = serialManagerThread(q, ser, pq)
-    imageThread =  dealWithImageThread(q, pq, mode, ser, size)
+    imageThread =  dealWithImageThread(q, pq, mode, ser, size, send)
     # Get matrix for image
     '''
     if (mode == 1):
@@ -745,7 +935,8 @@ def main():
 	imageThread.start()
 	printThread.start()
 	#threadPop.start()
-	threadSerial.start()
+	if (send == streamed):
+	    threadSerial.start()
     except(KeyboardInterrupt, SystemExit):
 	print "Shutting Down"
 	printThread.stop()
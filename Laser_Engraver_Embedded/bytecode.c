@@ -0,0 +1,559 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : bytecode.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-25 (Created), 2015-04-25 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Source code for the bytecode interpreter. A program draws
+//				 with a few instructions instead of one CMD_BURN per pixel,
+//				 and is either streamed by the Pi (CMD_CODE, during a
+//				 picture) or stored as a JOB_FORMAT_CODE job. Each
+//				 instruction is turned into burn commands as the burn queue
+//				 makes room.
+//
+//				 Operands follow the opcode, LSB first. Coordinates are
+//				 pixels, as for CMD_BURN, and a program that goes past
+//				 CODE_COORD_MAX is stopped.
+//
+//				   OP_END						the picture is done
+//				   OP_MOVE   x(2) y(2)			move there, laser off
+//				   OP_LINE   x(2) y(2)			line from the head to there
+//				   OP_ROW    count(2) bits		count pixels from the head
+//												along +x (count negative:
+//												along -x), one bit each, LSB
+//												first - burned where set
+//				   OP_DWELL  ms(2)				burn at the head for ms
+//												(0: the level's own time)
+//				   OP_POWER  level(1)			burn level for the above
+//				   OP_REPEAT n(2)				run up to the OP_NEXT n times
+//												(at least once)
+//				   OP_NEXT
+//
+//				 A streamed program is held in a ring, so a repeated block
+//				 (and each OP_ROW) must fit in CODE_RING_SIZE bytes, less
+//				 a CMD_CODE chunk.
+//				 A stored program that ends without OP_END ends there.
+//============================================================================
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "hal.h"
+#include "defs.h"
+#include "bytecode.h"
+#include "laser_driver.h"
+#include "scheduler.h"
+#include "ring.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+extern volatile uint8_t picture_ip;
+extern volatile uint8_t end_pending;
+
+// Streamed program bytes not yet run (filled by the comm task)
+static volatile uint8_t code_buf[CODE_RING_SIZE];
+static struct TRing code_ring;
+
+static uint32_t code_chunks = 0;			// CMD_CODE chunks taken for the streamed program
+
+static uint8_t  code_active = FALSE;
+static const uint8_t * code_mem = 0;		// Stored program, 0 when streamed
+static uint32_t code_length;				// Stored program bytes
+static uint32_t code_pc;					// Next instruction (from the ring head when streamed)
+
+static uint16_t code_x;						// Where the head is once the queued burns are done
+static uint16_t code_y;
+static uint8_t  code_level;					// Set by OP_POWER
+
+struct TCode_Loop
+{
+	uint32_t start;							// First instruction of the block
+	uint16_t left;							// Times still to run it
+};
+
+static struct TCode_Loop code_loop[CODE_LOOP_DEPTH];
+static uint8_t  code_depth;
+
+static uint16_t row_left;					// OP_ROW pixels still to run
+static uint16_t row_pixel;
+static int8_t   row_step;
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+void init_code( void )
+{
+	ring_init( &code_ring, code_buf, CODE_RING_SIZE, 1 );
+
+	code_stop();
+
+	return;
+}
+//============================================================================
+
+
+
+/*code_reset
+* Starts a program from the beginning
+* INPUT: Stored program, or 0 for a streamed one, and its length
+* RETURN: None
+*/
+static void code_reset( const uint8_t * code, uint32_t length )
+{
+	code_mem    = code;
+	code_length = length;
+	code_pc     = 0;
+
+	code_x     = 0;							// Programs start at home
+	code_y     = 0;
+	code_level = BURN_LEVEL_NONE;
+	code_depth = 0;
+	row_left   = 0;
+
+	code_active = TRUE;
+
+	return;
+}
+//============================================================================
+
+
+
+/*code_start
+* Runs a stored program. The picture must already be in progress
+*   (see service_start_request)
+* INPUT: Program and its length
+* RETURN: None
+*/
+void code_start( const uint8_t * code, uint32_t length )
+{
+	ring_clear( &code_ring );
+
+	code_reset( code, length );
+
+	return;
+}
+//============================================================================
+
+
+
+/*code_put
+* Adds the bytes of a CMD_CODE packet to the streamed program, starting one
+*   if none is running. Chunks must come in order, but the last chunk taken
+*   is acknowledged again without being added (its ACK was lost). The Pi
+*   waits on each chunk's ACK, so the low 8 bits of the index are enough
+* INPUT: CMD_CODE payload - chunk index (low 8 bits), byte count, then
+*   CODE_CHUNK_SIZE bytes
+* RETURN: TRUE if the bytes were taken, FALSE if there is no room (the Pi
+*   sends them again), the chunk is out of order or there is no picture to
+*   run them in
+*/
+uint8_t code_put( uint8_t * payload )
+{
+	uint8_t index = payload[0];
+	uint8_t count = payload[1];
+	uint8_t i;
+
+	if( picture_ip == FALSE || count > CODE_CHUNK_SIZE || ( code_active == TRUE && code_mem != 0 ) )
+	{
+		return FALSE;
+	}
+
+	if( code_chunks > 0 && index == (uint8_t)( code_chunks - 1 ) )
+	{
+		return TRUE;
+	}
+
+	if( index != (uint8_t)code_chunks || ring_free( &code_ring ) < count )
+	{
+		return FALSE;
+	}
+
+	if( code_active == FALSE )
+	{
+		// One program per picture - once it has ended (OP_END) nothing more is taken
+		if( code_chunks > 0 ) { return FALSE; }
+
+		ring_clear( &code_ring );
+		code_reset( 0, 0 );
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		ring_write( &code_ring, i, &payload[2 + i] );
+	}
+
+	ring_commit( &code_ring, count );
+	code_chunks++;
+
+	post_event( EV_BURN );
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*code_stop
+* Drops the program running, if any
+* INPUT: None
+* RETURN: None
+*/
+void code_stop( void )
+{
+	code_active = FALSE;
+	code_chunks = 0;
+
+	ring_clear( &code_ring );
+
+	return;
+}
+//============================================================================
+
+
+
+/*code_avail
+* INPUT: None
+* RETURN: Program bytes there are from the next instruction on
+*/
+static uint32_t code_avail( void )
+{
+	if( code_mem != 0 )
+	{
+		return code_length - code_pc;
+	}
+
+	return ring_count( &code_ring ) - code_pc;
+}
+//============================================================================
+
+
+
+/*code_byte
+* INPUT: Offset from the next instruction (must be within code_avail)
+* RETURN: The program byte there
+*/
+static uint8_t code_byte( uint32_t offset )
+{
+	uint8_t c;
+
+	if( code_mem != 0 )
+	{
+		return code_mem[ code_pc + offset ];
+	}
+
+	ring_peek( &code_ring, (uint16_t)( code_pc + offset ), &c );
+
+	return c;
+}
+//============================================================================
+
+
+
+static uint16_t code_word( uint32_t offset )
+{
+	return (uint16_t)code_byte( offset ) | ( (uint16_t)code_byte( offset + 1 ) << 8 );
+}
+//============================================================================
+
+
+
+static uint16_t row_count( int16_t count )
+{
+	return ( count < 0 ) ? (uint16_t)0 - (uint16_t)count : (uint16_t)count;
+}
+//============================================================================
+
+
+
+/*code_op_length
+* INPUT: None
+* RETURN: Bytes in the next instruction, 0 if that isn't known yet, or
+*   UINT16_MAX for an unknown opcode
+*/
+static uint16_t code_op_length( void )
+{
+	int16_t count;
+
+	if( code_avail() == 0 )
+	{
+		return 0;
+	}
+
+	switch( code_byte( 0 ) )
+	{
+		case OP_END    :
+		case OP_NEXT   : return 1;
+		case OP_POWER  : return 2;
+		case OP_DWELL  :
+		case OP_REPEAT : return 3;
+		case OP_MOVE   :
+		case OP_LINE   : return 5;
+
+		case OP_ROW    :
+			if( code_avail() < 3 ) { return 0; }
+
+			count = (int16_t)code_word( 1 );
+
+			return 3 + ( row_count( count ) + 7 ) / 8;
+
+		default        : return UINT16_MAX;
+	}
+}
+//============================================================================
+
+
+
+/*code_next
+* Moves on to the next instruction. A streamed program's bytes are let go of
+*   once no block can be repeated from them
+* INPUT: Bytes in this instruction
+* RETURN: None
+*/
+static void code_next( uint16_t length )
+{
+	code_pc += length;
+
+	if( code_mem == 0 && code_depth == 0 )
+	{
+		ring_release( &code_ring, (uint16_t)code_pc );
+		code_pc = 0;
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*code_burn
+* Queues a burn command at the head's position (there must be room)
+* INPUT: Burn level, keep-on flag and dwell time (ms, 0 for the default)
+* RETURN: None
+*/
+static void code_burn( uint8_t level, uint8_t keep_on, uint16_t dwell )
+{
+	struct TBurn_Cmd cmd;
+
+	cmd.x       = code_x;
+	cmd.y       = code_y;
+	cmd.level   = level;
+	cmd.keep_on = keep_on;
+	cmd.dither  = FALSE;
+	cmd.dwell   = dwell;
+
+	queue_burn( &cmd );
+
+	return;
+}
+//============================================================================
+
+
+
+/*code_row
+* Runs the next pixel of an OP_ROW
+* INPUT: None
+* RETURN: FALSE if the burn queue has no room for it, TRUE else
+*/
+static uint8_t code_row( void )
+{
+	if( ( code_byte( 3 + row_pixel / 8 ) >> ( row_pixel % 8 ) ) & 1 )
+	{
+		if( burn_queue_free() == 0 ) { return FALSE; }
+
+		code_burn( code_level, FALSE, 0 );
+	}
+
+	row_pixel++;
+	row_left--;
+
+	if( row_left > 0 )
+	{
+		code_x += row_step;
+	}
+	else
+	{
+		code_next( code_op_length() );
+	}
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*code_run_op
+* Runs the next instruction, which is all there. The burn queue must have room
+*   for two commands
+* INPUT: Bytes in the instruction
+* RETURN: FALSE if the program is wrong, TRUE else
+*/
+static uint8_t code_run_op( uint16_t length )
+{
+	int16_t count;
+	int32_t row_end;
+
+	switch( code_byte( 0 ) )
+	{
+		case OP_END:
+			// As for CMD_END - the picture finishes once the queued burns are done
+			code_active = FALSE;
+			end_pending = TRUE;
+			return TRUE;
+
+		case OP_MOVE:
+			if( code_word( 1 ) > CODE_COORD_MAX || code_word( 3 ) > CODE_COORD_MAX ) { return FALSE; }
+
+			code_x = code_word( 1 );
+			code_y = code_word( 3 );
+			code_burn( BURN_LEVEL_NONE, FALSE, 0 );
+			break;
+
+		case OP_LINE:
+			if( code_word( 1 ) > CODE_COORD_MAX || code_word( 3 ) > CODE_COORD_MAX ) { return FALSE; }
+
+			// The laser is left on at the start, so the move to the end draws the line
+			code_burn( code_level, TRUE, 0 );
+			code_x = code_word( 1 );
+			code_y = code_word( 3 );
+			code_burn( BURN_LEVEL_NONE, FALSE, 0 );
+			break;
+
+		case OP_ROW:
+			count = (int16_t)code_word( 1 );
+			if( count == 0 ) { break; }
+
+			// The whole row must stay in range (code_x would wrap going back past 0)
+			row_end = (int32_t)code_x + count + ( ( count < 0 ) ? 1 : -1 );
+			if( row_end < 0 || row_end > CODE_COORD_MAX ) { return FALSE; }
+
+			row_step  = ( count < 0 ) ? -1 : 1;
+			row_left  = row_count( count );
+			row_pixel = 0;
+			return TRUE;					// code_row moves on once the row is done
+
+		case OP_DWELL:
+			code_burn( code_level, FALSE, code_word( 1 ) );
+			break;
+
+		case OP_POWER:
+			code_level = code_byte( 1 );
+			break;
+
+		case OP_REPEAT:
+			if( code_depth == CODE_LOOP_DEPTH ) { return FALSE; }
+
+			code_loop[code_depth].start = code_pc + length;
+			code_loop[code_depth].left  = code_word( 1 );
+			code_depth++;
+			break;
+
+		case OP_NEXT:
+			if( code_depth == 0 ) { return FALSE; }
+
+			if( code_loop[code_depth - 1].left > 1 )
+			{
+				code_loop[code_depth - 1].left--;
+				code_pc = code_loop[code_depth - 1].start;
+				return TRUE;
+			}
+
+			code_depth--;
+			break;
+
+		default:
+			return FALSE;
+	}
+
+	code_next( length );
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*code_task
+* Scheduler task - runs the program until the burn queue is full or it has to
+*   wait on more streamed bytes. Stops if the burn is halted
+* INPUT: None
+* RETURN: None
+*/
+void code_task( void )
+{
+	uint16_t steps;
+	uint16_t length;
+
+	if( code_active == FALSE )
+	{
+		return;
+	}
+
+	if( picture_ip == FALSE )
+	{
+		code_stop();
+		return;
+	}
+
+	for( steps = 0; steps < CODE_STEPS_PER_TASK; steps++ )
+	{
+		if( row_left > 0 )
+		{
+			if( code_row() == FALSE ) { return; }
+			continue;
+		}
+
+		if( code_mem != 0 && code_avail() == 0 )
+		{
+			// Stored program ran out - as OP_END
+			code_active = FALSE;
+			end_pending = TRUE;
+			return;
+		}
+
+		length = code_op_length();
+
+		if(    length == UINT16_MAX
+			|| ( code_mem != 0 && ( length == 0 || length > code_avail() ) )
+			|| ( code_mem == 0 && code_pc + length + CODE_CHUNK_SIZE - 1 > CODE_RING_SIZE ) )
+		{
+			// Unknown instruction, one cut off at the end of a stored program, or
+			//   one the ring could never hold along with the block it repeats
+			code_stop();
+			halt_burn();
+			return;
+		}
+
+		if( length == 0 || length > code_avail() )
+		{
+			return;							// Wait for the Pi to send the rest
+		}
+
+		if( burn_queue_free() < 2 )
+		{
+			return;
+		}
+
+		if( code_run_op( length ) == FALSE )
+		{
+			code_stop();
+			halt_burn();
+			return;
+		}
+
+		if( code_active == FALSE )
+		{
+			return;
+		}
+	}
+
+	post_event( EV_BURN );					// Come back for the rest
+
+	return;
+}
+//============================================================================
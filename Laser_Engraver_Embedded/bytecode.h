@@ -0,0 +1,37 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : bytecode.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-25 (Created), 2015-04-25 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Header file including function prototypes and macros used for
+//				 the bytecode interpreter (programs streamed with CMD_CODE or
+//				 stored as a job)
+//============================================================================
+
+
+#ifndef BYTECODE_H_
+#define BYTECODE_H_
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "defs.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+void init_code( void );
+void code_start( const uint8_t * code, uint32_t length );
+uint8_t code_put( uint8_t * payload );
+void code_stop( void );
+void code_task( void );
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // BYTECODE_H_
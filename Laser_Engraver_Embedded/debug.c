@@ -12,7 +12,7 @@
 
 ////////////////////////////////////////////////////////////////////////////////
 
-#include "msp430f5529.h"
+#include "hal.h"
 #include "defs.h"
 #include "debug.h"
 
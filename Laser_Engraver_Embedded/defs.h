@@ -23,6 +23,7 @@
 #define JUST_INITIALIZED	2
 
 //#define DEBUG
+//#define PROFILE			// Build the hot path profile (see profile.c)
 //============================================================================
 
 
@@ -38,6 +39,38 @@
 
 
 
+//============================================================================
+// Time
+
+// MCLK and SMCLK both run from the DCO: (DCO_FLLN + 1) * 32768 Hz = 24.576 MHz
+#define DCO_FLLN				749
+#define SMCLK_HZ				24576000
+
+// Core voltage level required for MCLK above 20 MHz
+#define PMM_CORE_LEVEL			3
+
+// SMCLK counts per 10 us (rounded), used by the step and wait timers
+#define TMR_COUNTS_PER_10US		( ( SMCLK_HZ + 50000 ) / 100000 )
+
+// Laser PWM period (Timer A0); one period is also the 1 ms system tick
+#define PWM_PERIOD				( SMCLK_HZ / 1000 )
+
+// Timestamp timer (Timer B0) runs from SMCLK / 8 / 3 = 1.024 MHz, or from
+//   SMCLK itself when profiling, so the profile counts CPU cycles (it then
+//   overflows every 2.7 ms, and the 32-bit timestamp wraps after 174 s)
+#ifdef PROFILE
+#define TSTAMP_ID				ID_0				// No divider
+#define TSTAMP_IDEX				TBIDEX_0
+#define TSTAMP_TICKS_PER_MS		( SMCLK_HZ / 1000 )
+#else
+#define TSTAMP_ID				ID_3				// Input divider /8
+#define TSTAMP_IDEX				TBIDEX_2			// Input divider expansion /3
+#define TSTAMP_TICKS_PER_MS		1024
+#endif
+//============================================================================
+
+
+
 //============================================================================
 // Laser Driver
 
@@ -47,6 +80,12 @@
 #define FAN_ENA_PIN				BIT0
 #define LID_OPEN				BIT4
 
+// Time (ms) the laser must be held enabled after power-up before it can be used
+#define LASER_WARMUP_MS			8000
+
+// Time (ms) the lid must read closed before the interlock releases
+#define LID_DEBOUNCE_MS			20
+
 #define LASER_INTENSITY_MASK	0x18
 #define LASER_INTENSITY_SHIFT	3
 
@@ -56,12 +95,40 @@
 #define LASER_DUR_3				62
 #define LASER_DUR_4				100
 
-// PWM setting for each pixel value (time laser is on per 12300 ms cycle)
-#define FOCUS_INTENSITY 		1230	// 10%
-#define INTENSITY_1 			6458	// 52.5%
-#define INTENSITY_2 			11070	// 90%
-#define INTENSITY_3 			9840	// 80%
-#define MAX_INTENSITY 			12300	// 100%
+// PWM setting for each pixel value (counts the laser is on per PWM_PERIOD cycle)
+#define FOCUS_INTENSITY 		( PWM_PERIOD / 10 )			// 10%
+#define INTENSITY_1 			( PWM_PERIOD * 21 / 40 )	// 52.5%
+#define INTENSITY_2 			( PWM_PERIOD * 9 / 10 )		// 90%
+#define INTENSITY_3 			( PWM_PERIOD * 4 / 5 )		// 80%
+#define MAX_INTENSITY 			PWM_PERIOD					// 100%
+
+// Burn command payload: bit 0 requests the laser to stay on while moving to the next coordinate
+#define KEEP_ON_MASK			0x00000001
+
+// Burn command payload: bit 31 selects dithering, the gray value then takes bits 27-30
+#define DITHER_MASK				0x80000000
+#define DITHER_GRAY_MASK		0x78000000
+#define DITHER_GRAY_SHIFT		27
+#define DITHER_GRAY_MAX			15
+
+// Dithering - each pixel is split into DITHER_DIM x DITHER_DIM sub-dots, burned in the order
+//   given by an ordered (Bayer-style) threshold matrix. Sub-dot pitch must be a whole number of ticks
+#define DITHER_DIM				3
+#define DITHER_CELLS			( DITHER_DIM * DITHER_DIM )
+#define DITHER_MATRIX			{ 0, 7, 3, 6, 5, 2, 4, 1, 8 }
+#define DITHER_PITCH			( TCK2PXL / DITHER_DIM )			// Ticks between sub-dots
+#define DITHER_INTENSITY		MAX_INTENSITY
+#define DITHER_DOT_DUR			LASER_DUR_1
+
+// Burn level that only moves the head (the laser is turned off when it arrives)
+#define BURN_LEVEL_NONE			0xFF
+
+// Number of parsed burn commands that can wait behind the one in progress (must be a power of 2,
+//   at most 128). Deep, so the Pi can fall behind for a while without the head stopping
+#define BURN_QUEUE_SIZE			128
+
+// Number of burn events kept in the trace ring buffer (must be a power of 2)
+#define TRACE_SIZE				64
 //============================================================================
 
 
@@ -80,6 +147,19 @@
 #define MIN_TCK_DELAY_DIV2	MIN_TCK_DELAY / 2
 #define MAX_TCK_DELAY		8 * MIN_TCK_DELAY					// Minimum tick delay (maximum speed)
 #define HOME_TCK_DELAY		96 / TCK2STEP						// Delay for each tick (homing speed)
+#define HOME_SETTLE_MS		20									// A home switch already closed must stay closed this long
+#define HOME_DEBOUNCE_MS	5									// A home switch hit while homing must stay closed this long
+
+// Delay for each tick (both high and low) while the laser is held on between two coordinates,
+//   chosen so a continuous line gets the same dwell per pixel as a discrete burn at that level
+#define VECTOR_TCK_DELAY( dur_ms )	( ( dur_ms ) * 100 / ( 2 * TCK2PXL ) )
+
+
+// Longest delay (10 us) loaded into the step timer (or delay_10us()'s timer) at once (keeps the compare value in 16 bits)
+#define STEP_CHUNK_10US		250
+
+// Moves the step interrupt can have queued (must be a power of 2)
+#define MOTION_QUEUE_SIZE	16
 
 
 #define ACCEL_FACTORS 		{ 7.614640733, 3.154087464, 2.420216434, 2.040336835, 1.797572837, 1.625130067, 1.494461332, 1.391010692, 1.306465805, 1.235686081, 1.175297945, 1.122983037, 1.077088345, 1.036399139, 1 }
@@ -96,11 +176,12 @@
 #define TXD 		BIT2
 
 
+// 24.576 MHz SMCLK, 115200 baud: N = 213.33, oversampled UCBRx = 13, UCBRFx = 5
 #define UCA1_OS   	1    // 1 = oversampling mode, 0 = low-freq mode
-#define UCA1_BR0  	17   // Value of UCA1BR0 register
+#define UCA1_BR0  	13   // Value of UCA1BR0 register
 #define UCA1_BR1  	0    // Value of UCA1BR1 register
 #define UCA1_BRS  	0    // Value of UCBRS field in UCA1MCTL register
-#define UCA1_BRF  	6    // Value of UCBRF field in UCA1MCTL register
+#define UCA1_BRF  	5    // Value of UCBRF field in UCA1MCTL register
 
 // Special characters
 #define ETX		  	0X03
@@ -118,6 +199,19 @@
 #define CMD_INIT		0x01		// PI/MSP -> MSP/Pi : Pi/MSP is initialized and ready to proceed (no payload)
 #define CMD_START		0x11		// PI     -> MSP    : Pi will commence sending burn pixel commands (no payload)
 #define CMD_END			0x0F		// PI     -> MSP    : Pi indicates to the MSP that the picture is complete (no payload)
+#define CMD_RESUME		0x13		// PI     -> MSP    : Pi will carry on a halted picture - as CMD_START, but the lid needn't be opened first and the burn count carries on. During a picture, releases the lid interlock (NAKed while the lid is open) (no payload)
+#define CMD_PROGRESS	0x25		// MSP    -> PI     : Burn commands finished before the picture was halted, sent after CMD_INIT (payload is the count)
+#define CMD_TRACE		0x21		// PI/MSP -> MSP/PI : Pi requests the burn trace / MSP sends one burn event (payload is the packed event)
+#define CMD_TRACE_END	0x23		// MSP    -> PI     : MSP has sent every burn event in the trace (no payload)
+#define CMD_JOB_BEGIN	0x31		// PI     -> MSP    : Pi will upload a job to flash, erasing the last one (no payload)
+#define CMD_JOB_DATA	0x33		// PI     -> MSP    : Next piece of the job image (payload is the chunk index and JOB_CHUNK_SIZE bytes)
+#define CMD_JOB_END		0x35		// PI     -> MSP    : Job image is complete (payload is its length, checksum and format)
+#define CMD_JOB_RUN		0x37		// PI     -> MSP    : Burn the job in flash - as CMD_START, but the Pi isn't needed after (no payload)
+#define CMD_CODE		0x39		// PI     -> MSP    : Next bytes of a bytecode program to run (payload is the chunk index, the byte count and CODE_CHUNK_SIZE bytes)
+#define CMD_STATS		0x27		// PI/MSP -> MSP/PI : Pi requests the statistics (payload is TRUE to reset them once sent) / MSP sends one counter (payload is its STAT_x id and value)
+#define CMD_STATS_END	0x29		// MSP    -> PI     : MSP has sent every counter (no payload)
+#define CMD_PROFILE		0x2B		// PI/MSP -> MSP/PI : Pi requests the profile (payload is TRUE to reset it once sent) / MSP sends one field (payload is its index and value, as for CMD_STATS). Refused unless built with PROFILE
+#define CMD_PROFILE_END	0x2D		// MSP    -> PI     : MSP has sent the whole profile (no payload)
 
 
 #define CMD_BURN_PAYLOAD_SIZE		4
@@ -126,6 +220,20 @@
 #define CMD_INIT_PAYLOAD_SIZE		0
 #define CMD_START_PAYLOAD_SIZE		0
 #define CMD_END_PAYLOAD_SIZE		0
+#define CMD_RESUME_PAYLOAD_SIZE		0
+#define CMD_PROGRESS_PAYLOAD_SIZE	4
+#define CMD_TRACE_PAYLOAD_SIZE		0
+#define CMD_TRACE_EVENT_SIZE		8
+#define CMD_TRACE_END_PAYLOAD_SIZE	0
+#define CMD_JOB_BEGIN_PAYLOAD_SIZE	0
+#define CMD_JOB_DATA_PAYLOAD_SIZE	( 2 + JOB_CHUNK_SIZE )
+#define CMD_JOB_END_PAYLOAD_SIZE	8
+#define CMD_JOB_RUN_PAYLOAD_SIZE	0
+#define CMD_CODE_PAYLOAD_SIZE		( 2 + CODE_CHUNK_SIZE )
+#define CMD_STATS_PAYLOAD_SIZE		1
+#define CMD_STATS_VALUE_SIZE		5
+#define CMD_STATS_END_PAYLOAD_SIZE	0
+#define CMD_PROFILE_PAYLOAD_SIZE	1
 
 #define CMD_BURN_RESPONSE_SIZE		0
 #define CMD_READY_RESPONSE_SIZE		0
@@ -133,17 +241,178 @@
 #define CMD_INIT_RESPONSE_SIZE		0
 #define CMD_START_RESPONSE_SIZE		0
 #define CMD_END_RESPONSE_SIZE		0
+#define CMD_PROGRESS_RESPONSE_SIZE	0
 
-#define MAX_DATA_SIZE				4
+#define MAX_DATA_SIZE				10
 #define MIN_PACKET_LENGTH			3
 #define MAX_PACKET_LENGTH			3 + 2 * ( MAX_DATA_SIZE + 1 )
-#define FIFO_SIZE 					128
+#define TX_FIFO_SIZE 				128		// Must be a power of 2
+#define RX_FIFO_SIZE 				256		// Must be a power of 2
+#define RX_FRAME_QUEUE_SIZE			32		// Complete frames the rx fifo can hold (must be a power of 2)
+#define ACK_QUEUE_SIZE				8		// ACKs / NAKs held while the tx fifo is full (must be a power of 2)
+
 
+// Messages the Pi must acknowledge are resent RETX_TIMEOUT ms after they were
+//   sent, and the wait doubles after every attempt up to RETX_MAX_TIMEOUT
+#define RETX_TIMEOUT				250 	// milliseconds
+#define RETX_MAX_TIMEOUT			2000 	// milliseconds
+#define RETX_FOREVER				0		// Attempts for messages resent until acknowledged
 
-#define MAX_ATTEMPTS				3
+#define MAX_ATTEMPTS				6		// Ready for pixel requests (~7.75 s) before halting
 #define PIXEL_TIMEOUT				3000 	// milliseconds
 //============================================================================
 
+
+
+//============================================================================
+// Job (uploaded to flash)
+
+// Flash reserved for the job image - banks C and D, kept clear of code by
+//   JOBFLASH in lnk_msp430f5529.cmd
+#define JOB_FLASH_START			0x14400UL
+#define JOB_FLASH_SIZE			0x10000UL
+#define JOB_FLASH_BANK_SIZE		0x8000UL
+
+// The header (see TJob_Header) is written once the whole image has been checked
+#define JOB_HEADER_SIZE			16
+#define JOB_DATA_MAX			( JOB_FLASH_SIZE - JOB_HEADER_SIZE )
+#define JOB_MAGIC				0x4A42
+
+#define JOB_CHUNK_SIZE			8		// Job bytes in each CMD_JOB_DATA packet
+
+// Job formats
+#define JOB_FORMAT_BURN			1		// CMD_BURN payloads, in data[] order (LSB first)
+#define JOB_FORMAT_RASTER		2		// 2-bit packed raster, LZ / RLE compressed (see job.c)
+#define JOB_FORMAT_CODE			3		// Bytecode program (see bytecode.c)
+#define JOB_BURN_RECORD_SIZE	CMD_BURN_PAYLOAD_SIZE
+
+#define JOB_RASTER_HEADER_SIZE	12
+#define JOB_SYM_SKIP			0xFF	// Raster symbol level for pixels left blank
+#define JOB_LZ_WINDOW			256		// Decoded bytes kept for matches (power of 2, at most 256)
+#define JOB_PIXELS_PER_TASK		256		// Raster pixels decoded per pass of job_task
+//============================================================================
+
+
+
+//============================================================================
+// Bytecode (see bytecode.c for the operands)
+
+#define OP_END					0x00	// Program is done - finish the picture
+#define OP_MOVE					0x01	// Move to x, y with the laser off
+#define OP_LINE					0x02	// Burn a line from the head to x, y
+#define OP_ROW					0x03	// Burn a row of pixels along x, one bit each
+#define OP_DWELL				0x04	// Burn at the head for a given time
+#define OP_POWER				0x05	// Set the burn level used from here on
+#define OP_REPEAT				0x06	// Run the code up to the matching OP_NEXT n times
+#define OP_NEXT					0x07
+
+#define CODE_CHUNK_SIZE			8		// Program bytes in each CMD_CODE packet
+#define CODE_RING_SIZE			256		// Streamed program bytes held (must be a power of 2)
+#define CODE_LOOP_DEPTH			4		// OP_REPEATs that can be nested
+#define CODE_STEPS_PER_TASK		64		// Instructions / row pixels run per pass of code_task
+#define CODE_COORD_MAX			0x1FFF	// Largest x / y a program can reach (the 13 bits of a CMD_BURN)
+//============================================================================
+
+
+
+//============================================================================
+// Statistics (see stats.c)
+
+// Counters (the ids sent with CMD_STATS)
+#define STAT_RX_PACKETS			0		// Packets taken from the rx fifo
+#define STAT_RX_ERRORS			1		// Packets refused by parse_rx_packet (checksum, length, command or ETX)
+#define STAT_RX_OVERRUNS		2		// Frames dropped because the rx fifo or frame queue was full
+#define STAT_RX_RESYNCS			3		// Partial frames dropped because a new STX arrived
+#define STAT_TX_OVERRUNS		4		// Chars / packets refused because the tx fifo had no room
+#define STAT_NAKS_SENT			5
+#define STAT_NAKS_RECEIVED		6
+#define STAT_RESENDS			7		// Messages sent again for want of an acknowledgement
+#define STAT_READY_RESENDS		8		// ... of which were ready for pixel requests
+#define STAT_RETX_FAILURES		9		// Messages given up on
+#define STAT_PIXEL_TIMEOUTS		10		// Pictures halted for want of a burn command within PIXEL_TIMEOUT
+#define STAT_HALTS				11		// Pictures halted for any reason
+#define STAT_BURNS				12		// Burn commands finished
+#define STAT_COMM_WAIT_MS		13		// Picture time with no burn command to run
+#define STAT_MOTION_MS			14		// Picture time moving to the pixels
+#define STAT_BURN_MS			15		// Picture time burning with the head still
+#define STATS_COUNT				16
+
+// Phases a picture's time is split between (in the order of their STAT_x_MS)
+#define STATS_PHASE_COMM_WAIT	0
+#define STATS_PHASE_MOTION		1
+#define STATS_PHASE_BURN		2
+#define STATS_PHASE_NONE		0xFF	// Not counted (no picture, warming up)
+//============================================================================
+
+
+
+//============================================================================
+// Profiling (see profile.c, only built when PROFILE is defined)
+
+// Profiled sections
+#define PROF_PARSE_RX			0		// parse_rx_packet
+#define PROF_UART_GETP			1		// uart_getp
+#define PROF_PARSE_BURN			2		// parse_burn_cmd_payload
+#define PROF_QUEUE_MOVE			3		// queue_move (what the burn task moves with)
+#define PROF_START_LASER		4		// start_laser_timed (what the burn task burns with)
+#define PROF_ISR_STEP			5		// Timer A2 step interrupt
+#define PROF_ISR_UART			6		// USCI A1 interrupt
+#define PROF_ISR_TICK			7		// Timer A0 1 ms tick
+#define PROF_ISR_PORT2			8		// Home switch interrupt
+#define PROF_COUNT				9
+
+// Fields sent for each section, at index PROF_x * PROF_FIELDS + PROF_FIELD_x
+#define PROF_FIELD_COUNT		0
+#define PROF_FIELD_MIN			1
+#define PROF_FIELD_MAX			2
+#define PROF_FIELD_AVG			3
+#define PROF_FIELDS				4
+//============================================================================
+
+
+
+//============================================================================
+// Memory plan
+//
+// Every large buffer is a static pool sized above. The pools, the stack and
+//   the heap must fit in RAM together, which is checked when this file is
+//   compiled. Each pool's element size is checked against its struct where
+//   the pool is declared. What is left over is reserved for new buffers.
+
+// Fails the build (negative array size) if the condition is false
+#define MEM_CHECK( name, cond )		typedef char name[ ( cond ) ? 1 : -1 ]
+
+#define RAM_SIZE				0x2000	// RAM in lnk_msp430f5529.cmd (USB RAM is left alone)
+#define RAM_STACK_SIZE			160		// --stack_size in the project options
+#define RAM_HEAP_SIZE			160		// --heap_size in the project options
+
+// Everything outside the pools, which mapBudget.py checks against the link. The
+//   runtime library's share is from the last link (.cio, the stdio tables and
+//   __TI_tmpnams), ours is 698 bytes (874 with PROFILE) in the host build of
+//   sim/, whose pointers and ints are wider than the MSP430's
+#define RAM_RTS_SIZE			866
+#define RAM_VARS_SIZE			896
+#define RAM_OTHER_SIZE			( RAM_RTS_SIZE + RAM_VARS_SIZE )
+
+// Bytes planned for each element
+#define BURN_CMD_BYTES			16		// struct TBurn_Cmd
+#define BURN_EVENT_BYTES		8		// struct TBurn_Event
+#define MOTION_SEGMENT_BYTES	12		// struct TMotion_Segment
+
+#define RAM_POOLS_SIZE			( TX_FIFO_SIZE + RX_FIFO_SIZE + RX_FRAME_QUEUE_SIZE		\
+								+ ACK_QUEUE_SIZE    * 2									\
+								+ BURN_QUEUE_SIZE   * BURN_CMD_BYTES					\
+								+ TRACE_SIZE        * BURN_EVENT_BYTES					\
+								+ MOTION_QUEUE_SIZE * MOTION_SEGMENT_BYTES				\
+								+ JOB_LZ_WINDOW + CODE_RING_SIZE )
+
+#define RAM_PLAN_SIZE			( RAM_POOLS_SIZE + RAM_STACK_SIZE + RAM_HEAP_SIZE + RAM_OTHER_SIZE )
+
+MEM_CHECK( ram_plan_fits, RAM_PLAN_SIZE <= RAM_SIZE );
+MEM_CHECK( burn_queue_fits_free_count, BURN_QUEUE_SIZE <= 128 );
+MEM_CHECK( rx_frame_fits_length, MAX_PACKET_LENGTH <= 255 );		// Frame lengths are kept in a byte
+//============================================================================
+
 ////////////////////////////////////////////////////////////////////////////////
 
 
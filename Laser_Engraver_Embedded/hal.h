@@ -0,0 +1,52 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : hal.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Hardware abstraction - the register definitions every driver
+//				 uses, from the device header on the MSP430 or from the host
+//				 simulation (sim/) when built with SIM
+//============================================================================
+
+
+#ifndef HAL_H_
+#define HAL_H_
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#ifdef SIM
+	#include "sim/sim_hal.h"
+#else
+	#include "msp430f5529.h"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef SIM
+
+/*HAL_IDLE
+* Called in the body of every loop that waits on an interrupt. Nothing to do
+*   on the MSP430 (the interrupt ends the wait), the simulation runs its
+*   virtual time forward to the next hardware event here
+*/
+#define HAL_IDLE()
+
+/*HAL_FLASH_PTR
+* Pointer to a byte of the on-chip flash, for reading it or for the writes
+*   that program / erase it
+*/
+#define HAL_FLASH_PTR( addr )	( (uint8_t *)(uintptr_t)( addr ) )
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // HAL_H_
@@ -0,0 +1,623 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : job.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-23 (Created), 2015-04-24 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Source code for jobs uploaded to flash. The Pi streams the
+//				 job image in with CMD_JOB_BEGIN / DATA / END, each piece is
+//				 verified as it is written, and CMD_JOB_RUN burns it from
+//				 flash at motion speed with no traffic on the link.
+//
+//				 A JOB_FORMAT_RASTER job is a JOB_RASTER_HEADER_SIZE header
+//				 (width, height, x0, y0 - 2 bytes each, LSB first - then the
+//				 burn level for each of the 4 symbols), followed by the
+//				 raster compressed with the tokens below. Decompressed, it is
+//				 2-bit symbols packed 4 to a byte, low bits first, in burn
+//				 order: lines of y, starting at y0, each burned along x from
+//				 x0, back and forth (odd lines run from the far end).
+//
+//				   0x00 - 0x7F : the next token + 1 bytes, as they are
+//				   0x80 - 0xBF : the next byte, ( token & 0x3F ) + 3 times
+//				   0xC0 - 0xFF : ( token & 0x3F ) + 3 bytes copied from
+//								 ( next byte + 1 ) bytes back
+//
+//				 so only the last JOB_LZ_WINDOW decompressed bytes are kept.
+//============================================================================
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "hal.h"
+#include "defs.h"
+#include "job.h"
+#include "laser_driver.h"
+#include "scheduler.h"
+#include "bytecode.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+extern volatile uint8_t picture_ip;
+extern volatile uint8_t end_pending;
+
+static uint8_t  job_uploading = FALSE;		// Between CMD_JOB_BEGIN and CMD_JOB_END
+static uint32_t job_write_pos = 0;			// Job data bytes written so far
+
+static uint8_t  job_running   = FALSE;
+static uint32_t job_read_pos  = 0;			// Job data bytes handed to the burn queue / decoded
+
+// Compressed raster tokens
+#define LZ_RUN			0x80
+#define LZ_COPY			0xC0
+#define LZ_LENGTH_MASK	0x3F
+#define LZ_MIN_MATCH	3
+
+#define LZ_MODE_LITERAL	0
+#define LZ_MODE_RUN		1
+#define LZ_MODE_COPY	2
+
+static uint8_t  lz_window[JOB_LZ_WINDOW];	// Last bytes decompressed, for copies
+static uint16_t lz_pos;						// Bytes decompressed (window index, masked)
+static uint8_t  lz_left;					// Bytes left in the current token
+static uint8_t  lz_mode;
+static uint16_t lz_arg;						// Byte repeated, or distance copied from
+
+static uint16_t raster_width;
+static uint16_t raster_height;
+static uint16_t raster_x0;
+static uint16_t raster_y0;
+static uint8_t  raster_level[4];			// Burn level of each symbol (or JOB_SYM_SKIP)
+static uint16_t raster_dot;					// Position along the current line
+static uint16_t raster_line;
+static uint8_t  raster_bits;				// Symbols left in raster_byte
+static uint8_t  raster_byte;
+
+static void flash_erase_bank( uint32_t addr );
+static uint8_t flash_write( uint32_t addr, const uint8_t * data, uint16_t length );
+static void raster_start( void );
+static void raster_task( void );
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+/*job_flash
+* INPUT: Offset into the job flash
+* RETURN: Pointer to that byte of the job flash
+*/
+static uint8_t * job_flash( uint32_t offset )
+{
+	return HAL_FLASH_PTR( JOB_FLASH_START + offset );
+}
+//============================================================================
+
+
+
+static const struct TJob_Header * job_header( void )
+{
+	return (const struct TJob_Header *)job_flash( 0 );
+}
+//============================================================================
+
+
+
+/*flash_erase_bank
+* Erases the flash bank holding an address. The CPU is held for the ~30 ms
+*   this takes, so interrupts are off throughout
+* INPUT: Address in the bank
+* RETURN: None
+*/
+static void flash_erase_bank( uint32_t addr )
+{
+	uint16_t int_state = __get_interrupt_state();
+	__disable_interrupt();
+
+	FCTL3 = FWKEY;							// Clear LOCK
+	FCTL1 = FWKEY + MERAS;					// Bank erase
+	*(volatile uint16_t *)HAL_FLASH_PTR( addr ) = 0;	// Dummy write starts the erase
+	while( FCTL3 & BUSY );
+
+	FCTL1 = FWKEY;
+	FCTL3 = FWKEY + LOCK;
+
+	__set_interrupt_state( int_state );
+
+	return;
+}
+//============================================================================
+
+
+
+/*flash_write
+* Programs bytes into erased flash and reads them back
+* INPUT: Address, data and its length
+* RETURN: TRUE if the flash now holds the data, FALSE else
+*/
+static uint8_t flash_write( uint32_t addr, const uint8_t * data, uint16_t length )
+{
+	volatile uint8_t * dst = HAL_FLASH_PTR( addr );
+	uint16_t i;
+
+	uint16_t int_state = __get_interrupt_state();
+	__disable_interrupt();
+
+	FCTL3 = FWKEY;							// Clear LOCK
+	FCTL1 = FWKEY + WRT;					// Byte / word write
+
+	for( i = 0; i < length; i++ )
+	{
+		dst[i] = data[i];
+		while( FCTL3 & BUSY );
+	}
+
+	FCTL1 = FWKEY;
+	FCTL3 = FWKEY + LOCK;
+
+	__set_interrupt_state( int_state );
+
+	for( i = 0; i < length; i++ )
+	{
+		if( dst[i] != data[i] )
+		{
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*job_read16
+* INPUT: Offset into the job data
+* RETURN: The 16-bit value stored there, LSB first
+*/
+static uint16_t job_read16( uint32_t offset )
+{
+	return (uint16_t)*job_flash( JOB_HEADER_SIZE + offset )
+		 | ( (uint16_t)*job_flash( JOB_HEADER_SIZE + offset + 1 ) << 8 );
+}
+//============================================================================
+
+
+
+/*raster_header_ok
+* Checks the header of a raster job in flash before it is accepted
+* INPUT: Length of the job data
+* RETURN: TRUE if the raster fits the engraver, FALSE else
+*/
+static uint8_t raster_header_ok( uint32_t length )
+{
+	uint8_t i;
+	uint8_t level;
+
+	if( length <= JOB_RASTER_HEADER_SIZE )
+	{
+		return FALSE;
+	}
+
+	if(    job_read16( 0 ) == 0 || job_read16( 0 ) + job_read16( 4 ) > 0x2000
+		|| job_read16( 2 ) == 0 || job_read16( 2 ) + job_read16( 6 ) > 0x2000 )
+	{
+		return FALSE;
+	}
+
+	for( i = 0; i < 4; i++ )
+	{
+		level = *job_flash( JOB_HEADER_SIZE + 8 + i );
+
+		if( level != JOB_SYM_SKIP && level > 3 ) { return FALSE; }
+	}
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*lz_next_byte
+* Decompresses the next byte of a raster job (token format at the top of the
+*   file)
+* INPUT: None
+* RETURN: The byte
+*/
+static uint8_t lz_next_byte( void )
+{
+	uint32_t length = job_header()->length;
+	uint8_t token;
+	uint8_t c;
+
+	if( lz_left == 0 )
+	{
+		if( job_read_pos + 2 > length ) { return 0; }	// Image ran out early
+
+		token = *job_flash( JOB_HEADER_SIZE + job_read_pos++ );
+
+		if( token < LZ_RUN )
+		{
+			lz_mode = LZ_MODE_LITERAL;
+			lz_left = token + 1;
+		}
+		else
+		{
+			lz_mode = ( token < LZ_COPY ) ? LZ_MODE_RUN : LZ_MODE_COPY;
+			lz_left = ( token & LZ_LENGTH_MASK ) + LZ_MIN_MATCH;
+			lz_arg  = *job_flash( JOB_HEADER_SIZE + job_read_pos++ );
+
+			if( lz_mode == LZ_MODE_COPY ) { lz_arg++; }
+		}
+	}
+
+	if( lz_mode == LZ_MODE_LITERAL )
+	{
+		if( job_read_pos >= length ) { return 0; }
+
+		c = *job_flash( JOB_HEADER_SIZE + job_read_pos++ );
+	}
+	else if( lz_mode == LZ_MODE_RUN )
+	{
+		c = (uint8_t)lz_arg;
+	}
+	else
+	{
+		c = lz_window[ ( lz_pos - lz_arg ) & ( JOB_LZ_WINDOW - 1 ) ];
+	}
+
+	lz_window[ lz_pos & ( JOB_LZ_WINDOW - 1 ) ] = c;
+	lz_pos++;
+	lz_left--;
+
+	return c;
+}
+//============================================================================
+
+
+
+/*raster_start
+* Sets up the decoder at the start of the raster job in flash
+* INPUT: None
+* RETURN: None
+*/
+static void raster_start( void )
+{
+	uint16_t i;
+
+	raster_width  = job_read16( 0 );
+	raster_height = job_read16( 2 );
+	raster_x0     = job_read16( 4 );
+	raster_y0     = job_read16( 6 );
+
+	for( i = 0; i < 4; i++ )
+	{
+		raster_level[i] = *job_flash( JOB_HEADER_SIZE + 8 + i );
+	}
+
+	raster_dot  = 0;
+	raster_line = 0;
+	raster_bits = 0;
+
+	for( i = 0; i < JOB_LZ_WINDOW; i++ ) { lz_window[i] = 0; }
+
+	lz_pos  = 0;
+	lz_left = 0;
+
+	job_read_pos = JOB_RASTER_HEADER_SIZE;
+
+	return;
+}
+//============================================================================
+
+
+
+/*raster_next_pixel
+* Decodes the next pixel of the raster, in burn order
+* INPUT: Where to put its coordinates
+* RETURN: Burn level of the pixel, or JOB_SYM_SKIP if it is blank
+*/
+static uint8_t raster_next_pixel( uint32_t * x, uint32_t * y )
+{
+	uint8_t sym;
+
+	if( raster_bits == 0 )
+	{
+		raster_byte = lz_next_byte();
+		raster_bits = 4;
+	}
+
+	sym = raster_byte & 0x03;
+	raster_byte >>= 2;
+	raster_bits--;
+
+	*y = raster_y0 + raster_line;
+	*x = raster_x0 + ( ( raster_line & 1 ) ? ( raster_width - 1 - raster_dot ) : raster_dot );
+
+	if( ++raster_dot == raster_width )
+	{
+		raster_dot = 0;
+		raster_line++;
+	}
+
+	return raster_level[sym];
+}
+//============================================================================
+
+
+
+/*raster_task
+* job_task for a raster job - decodes pixels into the burn queue until it is
+*   full. Blank pixels don't take queue space, so a long blank stretch is
+*   split over several passes rather than holding up the other tasks
+* INPUT: None
+* RETURN: None
+*/
+static void raster_task( void )
+{
+	struct TBurn_Cmd cmd;
+	uint16_t pixels = 0;
+	uint8_t level;
+
+	cmd.keep_on = FALSE;
+	cmd.dither  = FALSE;
+	cmd.dwell   = 0;
+
+	while( raster_line < raster_height && burn_queue_free() > 0 )
+	{
+		if( pixels++ == JOB_PIXELS_PER_TASK )
+		{
+			post_event( EV_BURN );			// Come back for the rest
+			return;
+		}
+
+		level = raster_next_pixel( &cmd.x, &cmd.y );
+
+		if( level != JOB_SYM_SKIP )
+		{
+			cmd.level = level;
+			queue_burn( &cmd );
+		}
+	}
+
+	if( raster_line >= raster_height )
+	{
+		job_running = FALSE;
+		end_pending = TRUE;
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*job_begin
+* Starts a job upload, erasing the job flash (and so any job already in it).
+*   Not allowed while a picture is in progress
+* INPUT: None
+* RETURN: TRUE if ready for the job data, FALSE else
+*/
+uint8_t job_begin( void )
+{
+	uint32_t addr;
+
+	if( picture_ip == TRUE )
+	{
+		return FALSE;
+	}
+
+	for( addr = JOB_FLASH_START; addr < JOB_FLASH_START + JOB_FLASH_SIZE; addr += JOB_FLASH_BANK_SIZE )
+	{
+		flash_erase_bank( addr );
+	}
+
+	job_write_pos = 0;
+	job_uploading = TRUE;
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*job_data
+* Writes one CMD_JOB_DATA chunk. Chunks must come in order, but a chunk that is
+*   already written is accepted again if it matches (the ACK was lost)
+* INPUT: CMD_JOB_DATA payload - chunk index (LSB first), then JOB_CHUNK_SIZE bytes
+* RETURN: TRUE if the chunk is in flash, FALSE else
+*/
+uint8_t job_data( uint8_t * payload )
+{
+	uint32_t offset = ( (uint32_t)payload[0] | ( (uint32_t)payload[1] << 8 ) ) * JOB_CHUNK_SIZE;
+	uint8_t * chunk = &payload[2];
+	uint8_t i;
+
+	if( job_uploading == FALSE || offset + JOB_CHUNK_SIZE > JOB_DATA_MAX )
+	{
+		return FALSE;
+	}
+
+	if( offset < job_write_pos )
+	{
+		for( i = 0; i < JOB_CHUNK_SIZE; i++ )
+		{
+			if( *job_flash( JOB_HEADER_SIZE + offset + i ) != chunk[i] ) { return FALSE; }
+		}
+
+		return TRUE;
+	}
+
+	if( offset != job_write_pos )
+	{
+		return FALSE;
+	}
+
+	if( flash_write( JOB_FLASH_START + JOB_HEADER_SIZE + offset, chunk, JOB_CHUNK_SIZE ) == FALSE )
+	{
+		// Can't be written again without erasing - the upload has to start over
+		job_uploading = FALSE;
+		return FALSE;
+	}
+
+	job_write_pos += JOB_CHUNK_SIZE;
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*job_end
+* Finishes an upload - checks the image in flash against the length and
+*   checksum the Pi sent, then writes the header that makes it runnable
+* INPUT: CMD_JOB_END payload - length (4 bytes), checksum (2), format (2), LSB first
+* RETURN: TRUE if the job is ready to run, FALSE else
+*/
+uint8_t job_end( uint8_t * payload )
+{
+	struct TJob_Header header;
+	uint16_t checksum = 0;
+	uint32_t i;
+
+	header.magic    = JOB_MAGIC;
+	header.length   =   (uint32_t)payload[0]         | ( (uint32_t)payload[1] << 8 )
+					| ( (uint32_t)payload[2] << 16 ) | ( (uint32_t)payload[3] << 24 );
+	header.checksum = (uint16_t)payload[4] | ( (uint16_t)payload[5] << 8 );
+	header.format   = (uint16_t)payload[6] | ( (uint16_t)payload[7] << 8 );
+
+	if( job_uploading == FALSE || header.length > job_write_pos )
+	{
+		return FALSE;
+	}
+
+	if( header.format == JOB_FORMAT_BURN )
+	{
+		if( header.length % JOB_BURN_RECORD_SIZE != 0 ) { return FALSE; }
+	}
+	else if( header.format == JOB_FORMAT_RASTER )
+	{
+		if( raster_header_ok( header.length ) == FALSE ) { return FALSE; }
+	}
+	else if( header.format == JOB_FORMAT_CODE )
+	{
+		if( header.length == 0 ) { return FALSE; }
+	}
+	else
+	{
+		return FALSE;
+	}
+
+	for( i = 0; i < header.length; i++ )
+	{
+		checksum += *job_flash( JOB_HEADER_SIZE + i );
+	}
+
+	if( checksum != header.checksum )
+	{
+		return FALSE;
+	}
+
+	job_uploading = FALSE;
+
+	// Magic last, so a header cut short never reads as valid
+	if( flash_write( JOB_FLASH_START + 2, (uint8_t *)&header + 2, sizeof( header ) - 2 ) == FALSE )
+	{
+		return FALSE;
+	}
+
+	return flash_write( JOB_FLASH_START, (uint8_t *)&header, 2 );
+}
+//============================================================================
+
+
+
+/*job_valid
+* INPUT: None
+* RETURN: TRUE if a complete job is in flash, FALSE else
+*/
+uint8_t job_valid( void )
+{
+	const struct TJob_Header * header = job_header();
+
+	return ( header->magic == JOB_MAGIC && header->length <= JOB_DATA_MAX ) ? TRUE : FALSE;
+}
+//============================================================================
+
+
+
+/*job_start
+* Starts burning the job in flash from the beginning. The picture must already
+*   be in progress (see service_start_request)
+* INPUT: None
+* RETURN: None
+*/
+void job_start( void )
+{
+	job_read_pos = 0;
+	job_running  = ( job_valid() == TRUE ) ? TRUE : FALSE;
+
+	if( job_running == TRUE && job_header()->format == JOB_FORMAT_RASTER )
+	{
+		raster_start();
+	}
+	else if( job_running == TRUE && job_header()->format == JOB_FORMAT_CODE )
+	{
+		// Run by code_task, straight from flash
+		code_start( job_flash( JOB_HEADER_SIZE ), job_header()->length );
+		job_running = FALSE;
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*job_task
+* Scheduler task - keeps the burn queue topped up from the job in flash, and
+*   ends the picture once the whole job has been queued. Stops if the burn
+*   is halted
+* INPUT: None
+* RETURN: None
+*/
+void job_task( void )
+{
+	uint32_t length = job_header()->length;
+
+	if( job_running == FALSE )
+	{
+		return;
+	}
+
+	if( picture_ip == FALSE )
+	{
+		job_running = FALSE;
+		return;
+	}
+
+	if( job_header()->format == JOB_FORMAT_RASTER )
+	{
+		raster_task();
+		return;
+	}
+
+	while( job_read_pos < length && burn_queue_free() > 0 )
+	{
+		queue_burn_cmd( job_flash( JOB_HEADER_SIZE + job_read_pos ) );
+		job_read_pos += JOB_BURN_RECORD_SIZE;
+	}
+
+	if( job_read_pos >= length )
+	{
+		// As for CMD_END - the picture finishes once the queued burns are done
+		job_running = FALSE;
+		end_pending = TRUE;
+	}
+
+	return;
+}
+//============================================================================
@@ -0,0 +1,53 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : job.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-23 (Created), 2015-04-23 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Header file including function prototypes and macros used for
+//				 jobs uploaded to flash and burned without the Pi
+//============================================================================
+
+
+#ifndef JOB_H_
+#define JOB_H_
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "defs.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*TJob_Header
+* Start of the job flash. Only valid once magic reads JOB_MAGIC, which is
+*   written last, after the image has been checked
+*/
+struct TJob_Header
+{
+	uint16_t magic;
+	uint16_t format;				// JOB_FORMAT_x
+	uint32_t length;				// Bytes of job data after the header
+	uint16_t checksum;				// 16-bit sum of the job data bytes
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+uint8_t job_begin( void );
+uint8_t job_data ( uint8_t * payload );
+uint8_t job_end  ( uint8_t * payload );
+
+uint8_t job_valid( void );
+void job_start( void );
+void job_task( void );
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // JOB_H_
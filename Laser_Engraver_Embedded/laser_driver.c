@@ -13,25 +13,89 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 
-#include "msp430f5529.h"
+#include "hal.h"
 #include "defs.h"
 #include "laser_driver.h"
 #include "uart_fifo.h"
 #include "time.h"
 #include "motors.h"
+#include "scheduler.h"
+#include "ring.h"
+#include "stats.h"
+#include "profile.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
 uint8_t laser_on = FALSE;
-uint32_t intensity_buffer[100];
-uint32_t x_pos_buffer[100];
-uint32_t y_pos_buffer[750];
 
-uint16_t buffer_it = 0;
+// Burn commands finished since CMD_START (carried on by CMD_RESUME), and whether
+//   the picture was halted before it ended
+uint32_t burns_done     = 0;
+uint8_t  picture_halted = FALSE;
+
+// Burn trace (ring buffer, burn_trace_head is the next slot to write)
+struct TBurn_Event burn_trace[TRACE_SIZE];
+uint16_t burn_trace_head  = 0;
+uint16_t burn_trace_count = 0;
+
+// Laser setting for each pixel value
+#define BURN_LEVELS		4
+static const uint16_t burn_intensity[BURN_LEVELS] = { INTENSITY_1, INTENSITY_2, INTENSITY_3, MAX_INTENSITY };
+static const uint16_t burn_duration [BURN_LEVELS] = { LASER_DUR_1, LASER_DUR_2, LASER_DUR_3, LASER_DUR_4 };
+
+// Keep-on command waiting for the next command's move to draw its segment, the
+//   laser setting and tick delay for that move
+static uint8_t  vector_pending   = FALSE;
+static uint16_t vector_intensity = 0;
+uint16_t vector_tck_delay = VECTOR_TCK_DELAY( LASER_DUR_4 );
+
+// Threshold for each sub-dot of a dithered pixel
+static const uint8_t dither_matrix[DITHER_CELLS] = DITHER_MATRIX;
+
+// Power-up warm-up state (laser can't be used until laser_ready is set)
+volatile uint8_t laser_ready   = FALSE;
+volatile uint8_t laser_warming = FALSE;		// Cleared by the lid interlock to start over
+uint32_t laser_warmup_end = 0;
+
+// Lid interlock state (maintained by the 1 ms timer interrupt)
+volatile uint8_t  lid_open      = TRUE;
+volatile uint16_t lid_closed_ms = 0;
+volatile uint8_t  lid_cut       = FALSE;	// Laser was on when cut, and hasn't been re-enabled yet
+volatile uint8_t  lid_hold      = FALSE;	// Open, or tripped since the last lid_resume() - burns and moves wait
+
+// Burn commands received but not yet started (filled by the comm task)
+static struct TBurn_Cmd burn_queue[BURN_QUEUE_SIZE];
+static struct TRing burn_ring;
+
+MEM_CHECK( burn_cmd_fits_plan,   sizeof( struct TBurn_Cmd )   <= BURN_CMD_BYTES );
+MEM_CHECK( burn_event_fits_plan, sizeof( struct TBurn_Event ) <= BURN_EVENT_BYTES );
+
+// Time (ms) left on a timed burn (counted down by the 1 ms timer interrupt)
+volatile uint16_t burn_ms_left = 0;
+
+// Burn command in progress (see burn_task)
+#define BURN_IDLE			0
+#define BURN_WARMUP			1		// First pixel - waiting for the warm-up
+#define BURN_SETTLE			2		// First pixel - letting the driver settle
+#define BURN_MOVING			3		// Moving to the pixel
+#define BURN_DWELL			4		// Timed burn
+#define BURN_DOT_MOVING		5		// Moving to a dither sub-dot
+#define BURN_DOT_DWELL		6		// Burning a dither sub-dot
+#define BURN_HOMING			7		// Moving to the home position
+
+static uint8_t  burn_state = BURN_IDLE;
+static struct TBurn_Cmd burn;
+static uint16_t burn_dots;			// Sub-dots to burn (dither mode)
+static uint16_t burn_dot;			// Next sub-dot to check (dither mode)
+static uint32_t burn_start_time;
+static uint32_t burn_settle_end;
 
-extern volatile uint8_t burn_ready;
 extern volatile uint8_t picture_ip;
+extern volatile uint8_t first_pixel;
+extern volatile uint8_t door_opened;
+extern volatile uint8_t home_pending;
+extern volatile uint32_t time_ms;
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -40,6 +104,8 @@ void init_laser( void )
 {
 	disable_laser();
 
+	ring_init( &burn_ring, burn_queue, BURN_QUEUE_SIZE, sizeof( struct TBurn_Cmd ) );
+
 	// Set up TimerA_0 for PWM on the laser input
 	init_timer_A0();
 
@@ -63,6 +129,7 @@ void init_laser( void )
 void disable_laser( void )
 {
 	P1OUT |= LASER_ENA_PIN;		// Laser enabled
+	lid_cut = FALSE;			// Nothing for the lid interlock to turn back on
 
 	disable_fan();
 
@@ -119,6 +186,72 @@ void disable_fan( void )
 
 
 
+/*start_laser_warmup
+* Enables the laser and starts the power-up warm-up timer. Returns right away,
+*   service_laser_warmup() finishes the warm-up when the deadline passes so
+*   homing and the Pi handshake can run in the meantime
+* INPUT: None
+* RETURN: None
+*/
+void start_laser_warmup( void )
+{
+	laser_ready   = FALSE;
+	laser_warming = FALSE;
+
+	service_laser_warmup();
+
+	return;
+}
+//============================================================================
+
+
+
+/*service_laser_warmup
+* Advances the warm-up, call regularly until laser_ready is set
+* INPUT: None
+* RETURN: None
+*/
+void service_laser_warmup( void )
+{
+	uint16_t int_state;
+
+	if( laser_ready == TRUE )
+	{
+		return;
+	}
+
+	int_state = __get_interrupt_state();
+
+	// The interlock could cut the laser between the checks and the enable
+	__disable_interrupt();
+
+	// While the lid is open the interlock has cut the laser (and cleared
+	//   laser_warming), so the warm-up starts over once it is closed
+	if( lid_open == TRUE )
+	{
+		// Wait on the lid
+	}
+	else if( laser_warming == FALSE )
+	{
+		enable_laser();
+		laser_warmup_end = time_ms + LASER_WARMUP_MS;
+		laser_warming = TRUE;
+	}
+	else if( (int32_t)( time_ms - laser_warmup_end ) >= 0 )
+	{
+		disable_laser();
+		laser_warming = FALSE;
+		laser_ready = TRUE;
+	}
+
+	__set_interrupt_state( int_state );
+
+	return;
+}
+//============================================================================
+
+
+
 void turn_on_laser( uint16_t intensity )
 {
 	// Set Compare register 1 (Duty Cycle = TA0CCR1/TA0CCR0)
@@ -137,20 +270,60 @@ void turn_on_laser( uint16_t intensity )
 
 
 
-void turn_on_laser_timed( uint16_t intensity, uint16_t duration )
+/*start_laser_timed
+* Turns the laser on and returns, the 1 ms timer interrupt turns it off again
+*   after the duration (the count pauses while the lid interlock is tripped)
+* INPUT: PWM setting, duration (ms)
+* RETURN: None
+*/
+void start_laser_timed( uint16_t intensity, uint16_t duration )
 {
+	PROF_ENTER( PROF_START_LASER );
+
 	turn_on_laser( intensity );
 
-	delay_ms( duration );
+	__disable_interrupt();
+	burn_ms_left = duration;
+	__enable_interrupt();
 
-	turn_off_laser( );
-	
+	if( duration == 0 )
+	{
+		turn_off_laser();
+	}
+
+	PROF_EXIT( PROF_START_LASER );
 	return;
 }
 //============================================================================
 
 
 
+/*service_burn_timer
+* Counts down a timed burn, called from the 1 ms timer interrupt
+* INPUT: None
+* RETURN: TRUE when the burn has just finished
+*/
+uint8_t service_burn_timer( void )
+{
+	if( burn_ms_left == 0 || lid_hold == TRUE )
+	{
+		return FALSE;
+	}
+
+	burn_ms_left--;
+
+	if( burn_ms_left == 0 )
+	{
+		turn_off_laser();
+		return TRUE;
+	}
+
+	return FALSE;
+}
+//============================================================================
+
+
+
 void turn_off_laser( void )
 {
 	// Set Compare register 1 to 0 (turns off laser)
@@ -170,72 +343,392 @@ void turn_off_laser( void )
 
 
 
-void respond_to_burn_cmd( uint8_t * burn_cmd_payload )
+/*record_burn_event
+* Adds the finished burn command to the trace ring buffer
+* INPUT: None
+* RETURN: None
+*/
+static void record_burn_event( void )
 {
-	// Perform a burn (move laser to position, turn on laser)
-	uint32_t y_pos;
-	uint32_t x_pos;
-	uint32_t laser_intensity;
-	volatile uint16_t temp0 = burn_cmd_payload[0];
-	volatile uint16_t temp1 = burn_cmd_payload[1];
-	volatile uint16_t temp2 = burn_cmd_payload[2];
-	volatile uint16_t temp3 = burn_cmd_payload[3];
+	struct TBurn_Event * event = &burn_trace[ burn_trace_head & ( TRACE_SIZE - 1 ) ];
 
+	event->time     = (uint16_t)burn_start_time;
+	event->x        = ( burn.x & 0x1FFF ) | ( (uint16_t)burn.keep_on << 15 );
+	event->y        = ( burn.y & 0x1FFF ) | ( (uint16_t)( burn.level & 0x03 ) << 13 );
+	event->duration = (uint16_t)( time_ms - burn_start_time );
 
+	burn_trace_head++;
+	if( burn_trace_count < TRACE_SIZE ) { burn_trace_count++; }
+
+	return;
+}
+//============================================================================
+
+
+
+/*finish_burn
+* Ends the burn command (the next one was already requested when this one
+*   left the queue)
+* INPUT: None
+* RETURN: None
+*/
+static void finish_burn( void )
+{
+	record_burn_event();
+	burns_done++;
+	stats[STAT_BURNS]++;
+
+	burn_state = BURN_IDLE;
+
+	// Go straight on to the next command if one is already waiting
+	post_event( EV_BURN );
+
+	return;
+}
+//============================================================================
 
-	parse_burn_cmd_payload( burn_cmd_payload,
-							&y_pos,
-							&x_pos,
-							&laser_intensity );
 
-	/*if( buffer_it < 750  )
+
+/*begin_burn_move
+* Queues the move to the pixel
+* INPUT: None
+* RETURN: None
+*/
+static void begin_burn_move( void )
+{
+	if( vector_pending == TRUE )
 	{
-		intensity_buffer[buffer_it] = laser_intensity;
-		x_pos_buffer[buffer_it] = x_pos;
-		y_pos_buffer[buffer_it] = y_pos;
-		buffer_it++;
-	}*/
-	//buffer_it++;
-	
+		// Previous command asked for the laser to be kept on, so trace a straight
+		//   line to the new coordinate at the speed matching its intensity
+		vector_pending = FALSE;
+
+		if( laser_on == FALSE ) { turn_on_laser( vector_intensity ); }
 
-	// Move Laser
-	if( moveMotors( x_pos, y_pos ) == 1 )
+		queue_move_linear( burn.x * TCK2PXL, burn.y * TCK2PXL, vector_tck_delay );
+	}
+	else
 	{
-		halt_burn();
+		queue_move( burn.x * TCK2PXL, burn.y * TCK2PXL );
 	}
 
-	
-	if( !( P6IN & LID_OPEN ) )
+	burn_state = BURN_MOVING;
+
+	return;
+}
+//============================================================================
+
+
+
+/*next_dither_dot
+* Renders a gray value as a pattern of sub-dots within the pixel. The number of
+*   sub-dots follows the gray value, and which ones are burned is set by the
+*   ordered dither matrix, so neighbouring pixels blend into an even tone.
+*   Sub-dot rows are walked in a serpentine to keep the moves short.
+*   Queues the move to the next sub-dot, or ends the pixel if none are left
+* INPUT: None
+* RETURN: None
+*/
+static void next_dither_dot( void )
+{
+	uint16_t row;
+	uint16_t col;
+
+	while( burn_dot < DITHER_CELLS )
 	{
-		disable_laser();
-		while( !( P6IN & LID_OPEN ) );
-		enable_laser();
+		row = burn_dot / DITHER_DIM;
+		col = burn_dot % DITHER_DIM;
+		col = ( row & 1 ) ? ( DITHER_DIM - 1 - col ) : col;
+
+		burn_dot++;
+
+		if( dither_matrix[ row * DITHER_DIM + col ] < burn_dots )
+		{
+			queue_move( burn.x * TCK2PXL + col * DITHER_PITCH,
+						burn.y * TCK2PXL + row * DITHER_PITCH );
+
+			burn_state = BURN_DOT_MOVING;
+			return;
+		}
+	}
+
+	finish_burn();
+
+	return;
+}
+//============================================================================
+
+
+
+/*start_burn
+* Burns the pixel once the head has arrived
+* INPUT: None
+* RETURN: None
+*/
+static void start_burn( void )
+{
+	if( burn.dither == TRUE )
+	{
+		turn_off_laser();
+
+		burn_dots = ( burn.level * DITHER_CELLS + DITHER_GRAY_MAX / 2 ) / DITHER_GRAY_MAX;
+		burn_dot  = 0;
+
+		next_dither_dot();
+	}
+	else if( burn.level < BURN_LEVELS )
+	{
+		if( burn.keep_on == TRUE )
+		{
+			// The next command's move draws the segment (the laser is turned on as
+			//   it starts, not here, so it doesn't sit on one spot in between)
+			vector_pending   = TRUE;
+			vector_intensity = burn_intensity[burn.level];
+			vector_tck_delay = VECTOR_TCK_DELAY( burn_duration[burn.level] );
+
+			finish_burn();
+		}
+		else
+		{
+			start_laser_timed( burn_intensity[burn.level],
+							   ( burn.dwell != 0 ) ? burn.dwell : burn_duration[burn.level] );
+			burn_state = BURN_DWELL;
+		}
 	}
+	else
+	{
+		turn_off_laser();
+		finish_burn();
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*queue_burn_cmd
+* Parses a burn command payload into the burn queue, so it is ready to start
+*   the moment the command in progress finishes
+* INPUT: Burn command payload
+* RETURN: TRUE if queued, FALSE if the queue is full
+*/
+uint8_t queue_burn_cmd( uint8_t * burn_cmd_payload )
+{
+	struct TBurn_Cmd cmd;
+
+	if( burn_queue_free() == 0 )
+	{
+		return FALSE;
+	}
+
+	parse_burn_cmd_payload( burn_cmd_payload,
+							&cmd.y,
+							&cmd.x,
+							&cmd.level,
+							&cmd.keep_on,
+							&cmd.dither );
 
+	cmd.dwell = 0;
 
-	switch( laser_intensity )
+	return queue_burn( &cmd );
+}
+//============================================================================
+
+
+
+/*queue_burn
+* Adds an already parsed burn command to the burn queue
+* INPUT: Burn command
+* RETURN: TRUE if queued, FALSE if the queue is full
+*/
+uint8_t queue_burn( struct TBurn_Cmd * cmd )
+{
+	return ring_push( &burn_ring, cmd );
+}
+//============================================================================
+
+
+
+uint8_t burn_queue_free( void )
+{
+	return ring_free( &burn_ring );
+}
+//============================================================================
+
+
+
+uint8_t burn_busy( void )
+{
+	return ( burn_state != BURN_IDLE || ring_count( &burn_ring ) > 0 ) ? TRUE : FALSE;
+}
+//============================================================================
+
+
+
+void clear_burn_queue( void )
+{
+	ring_clear( &burn_ring );
+
+	return;
+}
+//============================================================================
+
+
+
+/*start_burn_cmd
+* Starts a burn command. The move, dwell and sub-dots are then stepped through
+*   by burn_task() as their events come in
+* INPUT: Parsed burn command
+* RETURN: None
+*/
+static void start_burn_cmd( struct TBurn_Cmd * cmd )
+{
+	burn = *cmd;
+	burn_start_time = time_ms;
+
+	if( first_pixel == TRUE )
+	{
+		burn_state = BURN_WARMUP;
+	}
+	else
 	{
-		case 0:  turn_on_laser_timed( INTENSITY_1, LASER_DUR_1 );
-				 break;
+		begin_burn_move();
+	}
+
+	return;
+}
+//============================================================================
 
-		case 1:  turn_on_laser_timed( INTENSITY_2, LASER_DUR_2 );
-				 break;
 
-		case 2:  turn_on_laser_timed( INTENSITY_3, LASER_DUR_3 );
-				 break;
 
-		case 3:  turn_on_laser_timed( MAX_INTENSITY, LASER_DUR_4 );
-				 break;
+/*burn_phase
+* Works out what the picture's time is being spent on, for the statistics
+* INPUT: None
+* RETURN: STATS_PHASE_x
+*/
+static uint8_t burn_phase( void )
+{
+	if( picture_ip == FALSE )
+	{
+		return STATS_PHASE_NONE;
+	}
 
-		default: break;
+	switch( burn_state )
+	{
+		case BURN_IDLE:			return STATS_PHASE_COMM_WAIT;
+		case BURN_MOVING:
+		case BURN_DOT_MOVING:
+		case BURN_HOMING:		return STATS_PHASE_MOTION;
+		case BURN_DWELL:
+		case BURN_DOT_DWELL:	return STATS_PHASE_BURN;
+		default:				return STATS_PHASE_NONE;
 	}
+}
+//============================================================================
 
 
-	// Reset the tracking variable
-	burn_ready = FALSE;
 
-	// When done executing the burn, request another command
-	send_ready_for_pixel();
+/*burn_task
+* Scheduler task for the burn commands and the power-up warm-up
+* INPUT: None
+* RETURN: None
+*/
+void burn_task( void )
+{
+	struct TBurn_Cmd cmd;
+
+	service_laser_warmup();
+
+	switch( burn_state )
+	{
+		case BURN_IDLE:
+			if( home_pending == TRUE )
+			{
+				// Asked for by the comm task - once the head has stopped (the burns
+				//   queued meanwhile start from home)
+				if( motion_busy() == FALSE )
+				{
+					home_pending = FALSE;
+					start_homing();
+					burn_state = BURN_HOMING;
+				}
+			}
+			else if( picture_ip == TRUE && ring_pop( &burn_ring, &cmd ) == TRUE )
+			{
+				start_burn_cmd( &cmd );
+			}
+			else if( laser_on == TRUE )
+			{
+				// A segment has ended with nothing queued after it - don't hold the
+				//   laser on the spot while waiting on the Pi (the next move turns
+				//   it back on if a keep-on is pending)
+				turn_off_laser();
+			}
+			break;
+
+		case BURN_HOMING:
+			if( service_homing() == FALSE )
+			{
+				burn_state = BURN_IDLE;
+			}
+			break;
+
+		case BURN_WARMUP:
+			// Hold the first burn until the power-up warm-up has finished
+			if( laser_ready == TRUE && lid_hold == FALSE )
+			{
+				enable_laser();
+				first_pixel = FALSE;
+
+				// Let the driver settle for at least 1 ms
+				burn_settle_end = time_ms + 2;
+				burn_state = BURN_SETTLE;
+			}
+			break;
+
+		case BURN_SETTLE:
+			if( (int32_t)( time_ms - burn_settle_end ) >= 0 )
+			{
+				begin_burn_move();
+			}
+			break;
+
+		case BURN_MOVING:
+		case BURN_DOT_MOVING:
+			// Wait for the head to arrive, and for the lid interlock to release
+			if( motion_busy() == TRUE || lid_hold == TRUE || lid_cut == TRUE )
+			{
+				break;
+			}
+
+			if( burn_state == BURN_MOVING )
+			{
+				start_burn();
+			}
+			else
+			{
+				start_laser_timed( DITHER_INTENSITY, DITHER_DOT_DUR );
+				burn_state = BURN_DOT_DWELL;
+			}
+			break;
+
+		case BURN_DWELL:
+			if( burn_ms_left == 0 ) { finish_burn(); }
+			break;
+
+		case BURN_DOT_DWELL:
+			if( burn_ms_left == 0 ) { next_dither_dot(); }
+			break;
+
+		default:
+			burn_state = BURN_IDLE;
+			break;
+	}
+
+	// Ask for the next pixel as soon as there is room to hold it
+	service_pixel_request();
+
+	stats_phase( burn_phase() );
 
 	return;
 }
@@ -250,6 +743,142 @@ void init_lid_safety( void )
 	P6REN |=  BIT4;  // pull up resistor
 	P6OUT |=  BIT4;
 
+	lid_closed_ms = 0;
+	lid_open = ( P6IN & LID_OPEN ) ? FALSE : TRUE;
+	lid_hold = lid_open;
+
+	return;
+}
+//============================================================================
+
+
+
+/*sample_lid_safety
+* Debounces the lid switch. Port 6 has no pin interrupts on the F5529, so this
+*   is called from the 1 ms timer interrupt instead. The laser is cut on the
+*   first open sample, but the lid must read closed for LID_DEBOUNCE_MS before
+*   the interlock releases.
+* INPUT: None
+* RETURN: TRUE when the interlock has just tripped or released
+*/
+uint8_t sample_lid_safety( void )
+{
+	uint8_t was_enabled;
+
+	if( !( P6IN & LID_OPEN ) )
+	{
+		if( lid_open == FALSE )
+		{
+			// Door has been opened - cut the laser right away, noting whether it was
+			//   enabled (low) so safety_task() turns it back on once resumed. Burns
+			//   and moves are held until then too. A warm-up that is
+			//   cut has to start over (whether or not service_laser_warmup() runs
+			//   while the lid is open), and restarts the laser itself
+			was_enabled = ( ( P1OUT & LASER_ENA_PIN ) || laser_warming == TRUE ) ? FALSE : TRUE;
+
+			disable_laser();
+
+			laser_warming = FALSE;
+			lid_open      = TRUE;
+			lid_cut       = was_enabled;
+			lid_hold      = TRUE;
+			door_opened = TRUE;
+			P3OUT |= PCB_LED;	// Turn on the debug LED
+
+			lid_closed_ms = 0;
+			return TRUE;
+		}
+
+		lid_closed_ms = 0;
+	}
+	else if( lid_open == TRUE )
+	{
+		lid_closed_ms++;
+
+		if( lid_closed_ms >= LID_DEBOUNCE_MS )
+		{
+			lid_open = FALSE;
+			P3OUT &= ~PCB_LED;	// Turn off the debug LED
+
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+//============================================================================
+
+
+
+/*lid_resume
+* Releases the lid interlock once the lid has been closed again. Closing the
+*   lid isn't enough by itself - the Pi has to resume (CMD_RESUME), or start a
+*   new picture, so nothing burns or moves by surprise when the lid comes down
+* INPUT: None
+* RETURN: TRUE if released (or nothing was held), FALSE while the lid is open
+*/
+uint8_t lid_resume( void )
+{
+	uint16_t int_state = __get_interrupt_state();
+	uint8_t released = FALSE;
+
+	// The interrupt could trip the interlock again between the check and the release
+	__disable_interrupt();
+
+	if( lid_open == FALSE )
+	{
+		lid_hold = FALSE;
+		released = TRUE;
+	}
+
+	__set_interrupt_state( int_state );
+
+	return released;
+}
+//============================================================================
+
+
+
+/*safety_task
+* Scheduler task for the lid interlock. Once the lid interlock has been
+*   released after cutting the laser, the driver is re-enabled (the PWM
+*   setting is left alone, so a burn or keep-on segment carries on). Disabling
+*   the laser in the meantime (the end of the picture, a halt) drops the
+*   re-enable
+* INPUT: None
+* RETURN: None
+*/
+void safety_task( void )
+{
+	uint16_t int_state = __get_interrupt_state();
+
+	// The interrupt could trip the interlock again between the check and the enable
+	__disable_interrupt();
+
+	if( lid_cut == TRUE && lid_open == FALSE && lid_hold == FALSE )
+	{
+		lid_cut = FALSE;
+		enable_laser();
+	}
+
+	__set_interrupt_state( int_state );
+
+	return;
+}
+//============================================================================
+
+
+
+/*cancel_vector
+* Turns the laser off and drops a pending keep-on, at the end of a picture
+* INPUT: None
+* RETURN: None
+*/
+void cancel_vector( void )
+{
+	vector_pending = FALSE;
+	turn_off_laser();
+
 	return;
 }
 //============================================================================
@@ -260,8 +889,20 @@ void halt_burn( void )
 {
 	// First disable the laser and make sure the PWM input is off
 	disable_laser();
-	turn_off_laser();
+	cancel_vector();
+	burn_ms_left = 0;
+
+	// Drop the pixel in progress, and any waiting
+	motion_stop();
+	burn_state = BURN_IDLE;
+	clear_burn_queue();
 	
+	// The Pi can carry on from burns_done once it is back (see CMD_RESUME)
+	if( picture_ip == TRUE )
+	{
+		picture_halted = TRUE;
+		stats[STAT_HALTS]++;
+	}
 	picture_ip = FALSE;
 	
 	// Tell the Pi the burn is ending
@@ -272,27 +913,4 @@ void halt_burn( void )
 
 ////////////////////////////////////////////////////////////////////////////////
 
-/*
-#pragma vector=PORT6_VECTOR
-__interrupt void PORT_6_ISR(void)
-{
-	volatile uint16_t fuck_all_the_things = P2IV;
-
-	if( fuck_all_the_things & P6IV_P6IFG2 ){   // Lid P2.2 interrupt
-		lid = 0;
-
-		debounce_lid = TRUE;
-
-		// need to shut down laser here
-		if( picture_ip == TRUE )
-		{
-			halt_burn();
-		}
-	}
-
-	P2IFG &= ~BIT2; // P2.2 IFG cleared
-}*/
-
-////////////////////////////////////////////////////////////////////////////////
-
 
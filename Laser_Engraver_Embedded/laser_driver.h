@@ -19,7 +19,35 @@
 
 #include <stdint.h>
 
-#include "msp430f5529.h"
+#include "hal.h"
+#include "defs.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// One executed burn command, packed into 8 bytes for the trace ring buffer
+struct TBurn_Event
+{
+	uint16_t time;			// time_ms when the command started (lower 16 bits)
+	uint16_t x;				// x pixel (bits 0-12), keep-on flag (bit 15)
+	uint16_t y;				// y pixel (bits 0-12), intensity level (bits 13-14)
+	uint16_t duration;		// ms spent on the command (move + burn)
+};
+
+// One parsed burn command
+struct TBurn_Cmd
+{
+	uint32_t x;				// x pixel
+	uint32_t y;				// y pixel
+	uint32_t level;			// intensity level, or gray value in dither mode
+	uint8_t  keep_on;
+	uint8_t  dither;
+	uint16_t dwell;			// Burn time (ms), 0 for the level's own duration
+};
+
+extern struct TBurn_Event burn_trace[TRACE_SIZE];
+extern uint16_t burn_trace_head;
+extern uint16_t burn_trace_count;
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -34,11 +62,24 @@ void disable_fan( void );
 
 
 void turn_on_laser( uint16_t intensity );
-void turn_on_laser_timed( uint16_t intensity, uint16_t duration );
+void start_laser_timed( uint16_t intensity, uint16_t duration );
 void turn_off_laser( void );
-
-void respond_to_burn_cmd( uint8_t * burn_cmd_payload );
+void cancel_vector( void );
+uint8_t service_burn_timer( void );
+
+void start_laser_warmup( void );
+void service_laser_warmup( void );
+
+uint8_t queue_burn( struct TBurn_Cmd * cmd );
+uint8_t queue_burn_cmd( uint8_t * burn_cmd_payload );
+uint8_t burn_queue_free( void );
+uint8_t burn_busy( void );
+void clear_burn_queue( void );
+void burn_task( void );
 void init_lid_safety( void );
+uint8_t sample_lid_safety( void );
+uint8_t lid_resume( void );
+void safety_task( void );
 void halt_burn( void );
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -15,29 +15,31 @@
 
 #include <stdio.h>
 
-#include "msp430f5529.h"
+#include "hal.h"
 #include "defs.h"
 #include "uart_fifo.h"
 #include "laser_driver.h"
 #include "time.h"
 #include "debug.h"
 #include "motors.h"
+#include "scheduler.h"
+#include "bytecode.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
 // char test_string[8];
 
-extern volatile uint8_t packet_ready;
-extern volatile uint8_t burn_ready;
 extern volatile uint8_t picture_ip;
 extern volatile uint8_t pi_init;
+extern volatile uint8_t home_pending;
 extern uint32_t time_ms;
 
 extern volatile uint8_t debounce_xhome;
 extern volatile uint8_t debounce_yhome;
 
 // Declare true initially so it doesn't have to be opened again after startup
+//   (also set by the lid interlock whenever the lid is opened)
 volatile uint8_t door_opened = TRUE;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -69,19 +71,19 @@ int main( void )
 	#endif
 
 	init_clocks();
+	init_timestamp();
 	initWaitTimer();
 	init_laser();
 	init_fan();
     init_uart();
+	init_code();
 	initMotorIO();
 	init_lid_safety();
 
-	// homeLaser();		// Wait for Pi init command
-
-	// Enable laser on powerup (wait >7 seconds)
-	enable_laser();
-	delay_ms( 8000 );
-	disable_laser();
+	// Enable laser on powerup (must stay enabled >7 seconds), and home while it
+	//   warms up. The burn task does both, the Pi link is answered meanwhile
+	start_laser_warmup();
+	home_pending = TRUE;
 
 	/*volatile uint8_t ccs_bullshit = 0;
 
@@ -424,47 +426,8 @@ int main( void )
 
 
 	// ------------------------------
-	// Main loop
-	while( 1 )
-	{
-		struct TPacket_Data rx_data;
-		check_and_respond_to_msg( &rx_data );
-
-		if( !( P6IN & LID_OPEN ) )
-		{
-			// Door has been opened
-			door_opened = TRUE;
-			P3OUT ^= PCB_LED;	// Turn on the debug LED
-		}
-
-
-		if( pi_init != FALSE )
-		{
-			if( pi_init == JUST_INITIALIZED )
-			{
-				// Indicate to the Pi that everything has been initialized
-				//send_MSP_initialized();
-
-				pi_init = TRUE;	// Pi is initialized, and ping has been sent
-			}
-			else
-			{
-				if( picture_ip == TRUE )
-				{
-					if( burn_ready == TRUE ) { respond_to_burn_cmd( rx_data.data ); }
-				}
-				else
-				{
-					if( !( P6IN & LID_OPEN ) )
-					{
-						// Door has been opened
-						door_opened = TRUE;
-						P3OUT ^= PCB_LED;	// Turn on the debug LED
-					}
-				}
-			}
-		}
-	}
+	// Main loop (never returns - the tasks run as the interrupts post events)
+	run_scheduler();
 	// ------------------------------
 
 
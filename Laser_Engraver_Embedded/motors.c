@@ -15,19 +15,23 @@
 
 #include <stdint.h>
 
-#include "msp430f5529.h"
+#include "hal.h"
 #include "defs.h"
 #include "motors.h"
 #include "time.h"
 #include "laser_driver.h"
+#include "scheduler.h"
+#include "uart_fifo.h"
+#include "ring.h"
+#include "profile.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
-volatile double X = 0;  		//Current X pixel assuming
-volatile double Y = 0;  		//Current Y pixel assuming
-volatile double ticksX = 0; 	//global ticks
-volatile double ticksY = 0; 	//global ticks
+volatile uint32_t xPos = 0;		//Current X position (ticks, kept by the step interrupt)
+volatile uint32_t yPos = 0;		//Current Y position (ticks, kept by the step interrupt)
+uint32_t xPlan = 0;				//X position once every queued segment has run (ticks)
+uint32_t yPlan = 0;				//Y position once every queued segment has run (ticks)
 volatile int homeX = 1; 		//flag for homing x
 volatile int homeY = 1; 		//flag for homing y
 volatile int lid = 1; 			//flag for lid
@@ -39,8 +43,83 @@ volatile uint8_t debounce_yhome = FALSE;
 
 uint32_t accel_delay[ACCEL_SIZE];
 
+// One straight move for the step interrupt
+struct TMotion_Segment
+{
+	uint32_t x;					// Target position (ticks)
+	uint32_t y;
+	uint16_t tck_delay;			// Delay (10 us) for each tick high and low, 0 = accelerate
+};
+
+// Motion queue (filled by main, emptied by the step interrupt)
+static struct TMotion_Segment motion_queue[MOTION_QUEUE_SIZE];
+static struct TRing motion_ring;
+
+MEM_CHECK( motion_segment_fits_plan, sizeof( struct TMotion_Segment ) <= MOTION_SEGMENT_BYTES );
+static volatile uint8_t motion_running = FALSE;
+
+// Segment in progress (step interrupt only)
+static uint16_t seg_major;			// Ticks on the longer axis
+static uint16_t seg_minor;			// Ticks on the shorter axis
+static uint16_t seg_it;				// Ticks done
+static int32_t  seg_error;			// Bresenham error (seg_major can pass INT16_MAX)
+static uint16_t seg_delay;			// Fixed tick delay, 0 = accelerate
+static uint8_t  seg_x_major;
+static uint8_t  seg_minor_step;
+static int8_t   seg_x_dir;
+static int8_t   seg_y_dir;
+static uint8_t  step_high;
+static uint16_t step_delay_left;	// 10 us left before the next step edge
+static uint16_t accel_it;
+static uint16_t repeat_it;
+static uint16_t repeat_count;
+static uint16_t num_accel_it;
+
+// Homing (home_state) - the step interrupt runs each axis toward its switch,
+//   then service_homing() checks the switch stays closed
+#define HOME_IDLE			0
+#define HOME_X_SEEK			1			// Stepping X toward its switch
+#define HOME_X_CHECK		2			// X switch closed, debouncing it
+#define HOME_Y_SEEK			3
+#define HOME_Y_CHECK		4
+
+static volatile uint8_t  home_state = HOME_IDLE;
+static volatile uint32_t home_check_end;	// time_ms the switch must still be closed at
+
 extern volatile uint8_t picture_ip;
+extern volatile uint8_t lid_hold;
+extern volatile uint32_t time_ms;
+
+
+// Step and direction pins
+#ifdef DEBUG
+	// The debug LED flashes with the X steps
+	#define X_STEP_HIGH()		( P4OUT |=  BIT3, P1OUT |=  DEBUG_LED )
+	#define X_STEP_LOW()		( P4OUT &= ~BIT3, P1OUT &= ~DEBUG_LED )
+	#define X_DIR_POSITIVE()	( P4OUT |=  BIT0 )
+	#define X_DIR_NEGATIVE()	( P4OUT &= ~BIT0 )
+	#define Y_STEP_HIGH()		( P3OUT |=  BIT7 )
+	#define Y_STEP_LOW()		( P3OUT &= ~BIT7 )
+	#define Y_DIR_POSITIVE()	( P8OUT |=  BIT2 )
+	#define Y_DIR_NEGATIVE()	( P8OUT &= ~BIT2 )
+	#define ENABLE_DRIVERS()	{ P6OUT |= BIT0; P6OUT &= ~BIT1; }
+	#define DISABLE_DRIVERS()	{ P6OUT &= ~BIT0; P6OUT |= BIT1; }
+#else
+	#define X_STEP_HIGH()		( P7OUT |=  BIT5 )
+	#define X_STEP_LOW()		( P7OUT &= ~BIT5 )
+	#define X_DIR_POSITIVE()	( P7OUT &= ~BIT7 )
+	#define X_DIR_NEGATIVE()	( P7OUT |=  BIT7 )
+	#define Y_STEP_HIGH()		( P3OUT |=  BIT6 )
+	#define Y_STEP_LOW()		( P3OUT &= ~BIT6 )
+	#define Y_DIR_POSITIVE()	( P4OUT &= ~BIT0 )
+	#define Y_DIR_NEGATIVE()	( P4OUT |=  BIT0 )
+	#define ENABLE_DRIVERS()	{ P4OUT |= BIT6; P7OUT &= ~BIT6; }
+	#define DISABLE_DRIVERS()	{ P4OUT &= ~BIT6; P7OUT |= BIT6; }
+#endif
 
+// Home switches (low when closed)
+#define X_HOME_CLOSED()			( ( P2IN & BIT0 ) ? FALSE : TRUE )
+#define Y_HOME_CLOSED()			( ( P2IN & BIT1 ) ? FALSE : TRUE )
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -172,6 +251,8 @@ void initMotorIO(void)
 		accel_delay[i] = MIN_TCK_DELAY * accel_factors[i];
 	}
 
+	initStepTimer();
+
 	_BIS_SR(GIE);          	// interrupts enabled
 
 	return;
@@ -181,504 +262,549 @@ void initMotorIO(void)
 
 
 
-#ifdef DEBUG
-
-// Move motors - Launchpad
-uint8_t moveMotors( unsigned int Xnew, unsigned int Ynew ){
-	volatile uint32_t temp3 = TCK_DELAY;
-	/////////////enable drivers//////////////////////////
-	P6OUT |= BIT0;   //unreset drivers LAUNCHPAD
-	P6OUT &= ~BIT1;  //enable drivers LAUNCHPAD
+/*queue_segment
+* Adds a segment to the motion queue (main context only)
+* INPUT: Target position (ticks), tick delay (0 = accelerate)
+* RETURN: TRUE if queued, FALSE if the queue is full
+*/
+static uint8_t queue_segment( uint32_t x, uint32_t y, uint16_t tck_delay )
+{
+	struct TMotion_Segment seg;
 
+	seg.x = x;
+	seg.y = y;
+	seg.tck_delay = tck_delay;
 
-	////////////////Set X Direction//////////////////////////
-	if(X<Xnew)
-	{
-		P4OUT |= BIT0;  //positive direction ONLY FOR LAUNCHPAD TESTING
-	}
-	else
+	if( ring_push( &motion_ring, &seg ) == FALSE )
 	{
-		P4OUT &= ~BIT0;  //negative direction ONLY FOR LAUNCHPAD TESTING
+		return FALSE;
 	}
-	/////////////////////////////////////////////////////////
 
+	xPlan = x;
+	yPlan = y;
 
-	while( ( X - Xnew ) > .001 || ( X - Xnew ) < -.001 ){
-
-		if(X<Xnew){
+	return TRUE;
+}
+//============================================================================
 
-			P4OUT |= BIT3;  //set step pin  ONLY FOR LAUNCHPAD TESTING
-			P1OUT |= DEBUG_LED;
 
-			delay_10us( TCK_DELAY );
 
-			P4OUT &= ~BIT3; //reset step pin
-			P1OUT &= ~DEBUG_LED;
+/*load_step_delay
+* Starts the next part of a half-tick delay. Delays longer than the 16-bit
+*   compare register can hold are split into STEP_CHUNK_10US pieces
+* INPUT: None
+* RETURN: None
+*/
+static void load_step_delay( void )
+{
+	uint16_t chunk = ( step_delay_left > STEP_CHUNK_10US ) ? STEP_CHUNK_10US : step_delay_left;
 
-			delay_10us( TCK_DELAY );
+	step_delay_left -= chunk;
+	TA2CCR0 = chunk * TMR_COUNTS_PER_10US - 1;
 
-			ticksX += PXL2TCK;
-		}
-		else if(X>Xnew){
+	return;
+}
+//============================================================================
 
-			P4OUT |= BIT3;  //set step pin ONLY FOR LAUNCHPAD TESTING
 
-			delay_10us( TCK_DELAY );
-			
 
-			P4OUT &= ~BIT3; //reset step pin
+/*start_next_segment
+* Takes the next segment from the queue and sets up the directions, Bresenham
+*   counters and acceleration (interrupt context, or main with the step timer
+*   stopped). Zero-length segments are skipped.
+* INPUT: None
+* RETURN: TRUE if a segment was started, FALSE if the queue is empty
+*/
+static uint8_t start_next_segment( void )
+{
+	struct TMotion_Segment next_seg;
+	struct TMotion_Segment * seg = &next_seg;
+	uint16_t xDiff;
+	uint16_t yDiff;
 
-			delay_10us( TCK_DELAY );
-			ticksX -= PXL2TCK;
+	while( ring_pop( &motion_ring, &next_seg ) == TRUE )
+	{
+		if( xPos < seg->x )
+		{
+			X_DIR_POSITIVE();
+			seg_x_dir = 1;
+			xDiff = seg->x - xPos;
+		}
+		else
+		{
+			X_DIR_NEGATIVE();
+			seg_x_dir = -1;
+			xDiff = xPos - seg->x;
 		}
 
-		X = ticksX; //move to end of while
+		if( yPos < seg->y )
+		{
+			Y_DIR_POSITIVE();
+			seg_y_dir = 1;
+			yDiff = seg->y - yPos;
+		}
+		else
+		{
+			Y_DIR_NEGATIVE();
+			seg_y_dir = -1;
+			yDiff = yPos - seg->y;
+		}
 
-	}
+		if( xDiff == 0 && yDiff == 0 )
+		{
+			continue;
+		}
 
+		// Bresenham - the longer axis ticks every time, the shorter one when the error overflows
+		seg_x_major = ( xDiff >= yDiff ) ? TRUE : FALSE;
+		seg_major   = ( seg_x_major == TRUE ) ? xDiff : yDiff;
+		seg_minor   = ( seg_x_major == TRUE ) ? yDiff : xDiff;
+		seg_error   = seg_major / 2;
+		seg_it      = 0;
+		seg_delay   = seg->tck_delay;
+
+		// Same ramp as the old blocking moves: each acceleration step is repeated
+		//   so the ramp takes up to a quarter of the segment at either end
+		accel_it     = 0;
+		repeat_it    = 1;
+		repeat_count = 0;
+		num_accel_it = ACCEL_SIZE;
+
+		if( seg_major > ( 2 * ACCEL_SIZE ) )
+		{
+			repeat_it = seg_major / ( 2 * ACCEL_SIZE );
+			num_accel_it = ACCEL_SIZE * repeat_it;
+		}
+		else
+		{
+			accel_it = 3;
+			num_accel_it = 1;
+		}
 
-	////////////////Set Y Direction//////////////////////////
-	if(Y<Ynew)
-	{
-		P8OUT |= BIT2;  //positive direction ONLY FOR LAUNCHPAD TESTING
-	}
-	else
-	{
-		P8OUT &= ~BIT2;  //positive direction ONLY FOR LAUNCHPAD TESTING
+		return TRUE;
 	}
 
+	return FALSE;
+}
+//============================================================================
 
-	while( ( Y - Ynew ) > .001 || ( Y - Ynew ) < -.001 ){
 
-		if(Y<Ynew){
 
-			P3OUT |= BIT7;  //set step pin  ONLY FOR LAUNCHPAD TESTING
+/*start_motion
+* Starts the step timer if it is idle. The check is done with interrupts off,
+*   so a segment queued just as the interrupt runs dry is never stranded
+* INPUT: None
+* RETURN: None
+*/
+static void start_motion( void )
+{
+	__disable_interrupt();
 
-			delay_10us( TCK_DELAY );
+	if( motion_running == FALSE && start_next_segment() == TRUE )
+	{
+		ENABLE_DRIVERS();
 
-			P3OUT &= ~BIT7; //reset step pin
+		motion_running = TRUE;
+		step_high = FALSE;
 
-			delay_ms(1);
+		// First interrupt straight away, it raises the first step
+		step_delay_left = 1;
+		TA2CTL   = TASSEL_2 | TACLR;
+		load_step_delay();
+		TA2CCTL0 = CCIE;
+		TA2CTL   = TASSEL_2 | MC_1 | TACLR;
+	}
 
-			ticksY += PXL2TCK;
-		}
-		else if(Y>Ynew){
+	__enable_interrupt();
 
-			P3OUT |= BIT7;   // Set step pin ONLY FOR LAUNCHPAD TESTING
+	return;
+}
+//============================================================================
 
-			delay_10us( TCK_DELAY );
 
-			P3OUT &= ~BIT7; //reset step pin
 
-			delay_10us( TCK_DELAY );
-			ticksY -= PXL2TCK;
-		}
+void initStepTimer( void )
+{
+	// Timer A2 runs from SMCLK in 'up' mode while a move is in progress, its CCR0
+	//   interrupt times every step edge
+	TA2CTL   = TASSEL_2 | TACLR;
+	TA2CCTL0 = 0;
 
-		Y = ticksY; //move to end of while
-	  }
+	ring_init( &motion_ring, motion_queue, MOTION_QUEUE_SIZE, sizeof( struct TMotion_Segment ) );
+	motion_running = FALSE;
 
-	return 0;
+	return;
 }
+//============================================================================
 
 
 
+/*queue_move
+* Queues a move to the target, X first then Y, both accelerated. Returns
+*   straight away
+* INPUT: Target position (ticks)
+* RETURN: TRUE if queued, FALSE if the queue has no room for both segments
+*/
+uint8_t queue_move( uint32_t Xnew, uint32_t Ynew )
+{
+	PROF_ENTER( PROF_QUEUE_MOVE );
 
-#else
-// Move motors - PCB
-uint8_t moveMotors(unsigned int Xnew, unsigned int Ynew){
+	#ifdef DEBUG
+		// Launchpad can only move whole pixels
+		Xnew -= Xnew % TCK2PXL;
+		Ynew -= Ynew % TCK2PXL;
+	#endif
 
-	uint16_t xDiff;
-	uint16_t yDiff;
-	uint16_t i = 0;
-	uint16_t it_skip = 1;
-	uint16_t repeat_it = 1;
-	uint16_t accel_it = 0;
-	uint16_t num_accel_it = ACCEL_SIZE;
+	if( ring_free( &motion_ring ) < 2 )
+	{
+		PROF_EXIT( PROF_QUEUE_MOVE );
+		return FALSE;
+	}
 
-	/////////////enable drivers//////////////////////////
-	P4OUT |= BIT6;  //unreset drivers
-	P7OUT &= ~BIT6;  //enable drivers
+	queue_segment( Xnew, yPlan, 0 );
+	queue_segment( Xnew, Ynew,  0 );
 
+	start_motion();
 
-	////////////////Set X Direction//////////////////////////
-	if(X<Xnew)
-	{
-		P7OUT &= ~BIT7;  //negative direction
-		xDiff = ( Xnew - X ) * TCK2PXL;
-	}
-	else
-	{
-		P7OUT |= BIT7;  //positive direction
-		xDiff = ( X - Xnew ) * TCK2PXL;
-	}
+	PROF_EXIT( PROF_QUEUE_MOVE );
+	return TRUE;
+}
+//============================================================================
 
 
-	if( xDiff > ( 2 * ACCEL_SIZE ) )
-	{
-		repeat_it = xDiff / ( 2 * ACCEL_SIZE );
-		num_accel_it = ACCEL_SIZE * repeat_it;
-	}
-	else
-	{
-		accel_it = 3;
-		num_accel_it = 1;
-	}
-	/*else if( xDiff < ACCEL_SIZE )
+
+/*queue_move_linear
+* Queues a straight line to the target with both axes stepping together at a
+*   fixed rate (used while the laser is held on, so the burn stays even)
+* INPUT: Target position (ticks), delay (10 us) for each tick high and low
+* RETURN: TRUE if queued, FALSE if the queue is full
+*/
+uint8_t queue_move_linear( uint32_t Xnew, uint32_t Ynew, uint16_t tck_delay )
+{
+	#ifdef DEBUG
+		// Launchpad has no need for true vectors, approximate with a normal move
+		return queue_move( Xnew, Ynew );
+	#endif
+
+	if( queue_segment( Xnew, Ynew, ( tck_delay > 0 ) ? tck_delay : 1 ) == FALSE )
 	{
-		it_skip = ACCEL_SIZE / ( xDiff / 2 );
-		accel_it = ACCEL_SIZE - 1 - ( it_skip * ( xDiff / 2 - 1 ) );
-		num_accel_it = xDiff / 2;
+		return FALSE;
 	}
-	else if( xDiff < ( 2 * ACCEL_SIZE ) )
-	{
-		accel_it = ACCEL_SIZE - ( xDiff / 2 );
-		num_accel_it = ACCEL_SIZE - accel_it;
-	}*/
 
-	// Why did I think this was needed?
-	//num_accel_it /= it_skip;
+	start_motion();
 
+	return TRUE;
+}
+//============================================================================
 
-	/////////////////////////////////////////////////////////
 
-	for( i = 0; i < xDiff; i++ )
-	{
-		volatile uint16_t temp4 = accel_delay[accel_it];
-		P7OUT |= BIT5;  //set step pin
 
-		delay_10us( accel_delay[accel_it] );
+uint8_t motion_busy( void )
+{
+	return ( motion_running == TRUE || ring_count( &motion_ring ) > 0 ) ? TRUE : FALSE;
+}
+//============================================================================
 
-		P7OUT &= ~BIT5;
 
-		delay_10us( accel_delay[accel_it] );
 
+/*motion_stop
+* Stops stepping at once and drops anything still queued. The position is left
+*   wherever the head stopped
+* INPUT: None
+* RETURN: None
+*/
+void motion_stop( void )
+{
+	__disable_interrupt();
 
-		if(X<Xnew)
-		{
-			X += PXL2TCK;
-		}
-		else
-		{
-			X -= PXL2TCK;
-		}
+	TA2CCTL0 = 0;
+	TA2CTL   = TASSEL_2 | TACLR;
 
-		if( ( i % repeat_it ) == ( repeat_it - 1 ) )
-		{
-			if( i < ( num_accel_it - 1 ) )
-			{
-				accel_it += it_skip;
-			}
-			else if( i > ( xDiff - num_accel_it - 1 ) )
-			{
-				accel_it -= it_skip;
-			}
-		}
-	}
+	X_STEP_LOW();
+	Y_STEP_LOW();
 
-	X = Xnew;
-	/////////////////////////////////////////////////////////
+	ring_clear( &motion_ring );		// Consumer side, but the step interrupt is stopped
+	motion_running = FALSE;
+	home_state = HOME_IDLE;
 
+	xPlan = xPos;
+	yPlan = yPos;
 
-	////////////////Set Y Direction//////////////////////////
-	it_skip = 1;
-	repeat_it = 1;
-	accel_it = 0;
-	num_accel_it = ACCEL_SIZE;
+	__enable_interrupt();
 
+	return;
+}
+//============================================================================
 
-	if(Y<Ynew)
-	{
-		P4OUT &= ~BIT0;  //positive direction
-		yDiff = ( Ynew - Y ) * TCK2PXL;
-	}
-	else
-	{
-		P4OUT |= BIT0;  //positive direction
-		yDiff = ( Y - Ynew ) * TCK2PXL;
-	}
 
 
-	if( yDiff > ( 2 * ACCEL_SIZE ) )
-	{
-		repeat_it = yDiff / ( 2 * ACCEL_SIZE );
-		num_accel_it = ACCEL_SIZE * repeat_it;
-	}
-	else
-	{
-		accel_it = 3;
-		num_accel_it = 1;
-	}
-	/*else if( yDiff < ACCEL_SIZE )
+/*home_seek
+* Starts an axis stepping toward its home switch, or goes straight to checking
+*   the switch if it's already closed (step timer stopped)
+* INPUT: HOME_X_SEEK or HOME_Y_SEEK
+* RETURN: None
+*/
+static void home_seek( uint8_t seek_state )
+{
+	uint8_t closed = ( seek_state == HOME_X_SEEK ) ? X_HOME_CLOSED() : Y_HOME_CLOSED();
+
+	if( closed )
 	{
-		it_skip = ACCEL_SIZE / ( yDiff / 2 );
-		accel_it = ACCEL_SIZE - 1 - ( it_skip * ( yDiff / 2 - 1 ) );
-		num_accel_it = yDiff / 2;
+		home_check_end = time_ms + HOME_SETTLE_MS;
+		home_state     = seek_state + 1;
+		return;
 	}
-	else if( yDiff < ( 2 * ACCEL_SIZE ) )
-	{
-		accel_it = ACCEL_SIZE - ( yDiff / 2 );
-		num_accel_it = ACCEL_SIZE - accel_it;
-	}*/
 
+	home_state = seek_state;
+	step_high  = FALSE;
 
-	for( i = 0; i < yDiff; i++ )
-	{
-		volatile uint16_t temp5 = accel_delay[accel_it];
-		P3OUT |= BIT6;  // Set step pin
+	// First interrupt straight away, it raises the first step
+	step_delay_left = 1;
+	TA2CTL   = TASSEL_2 | TACLR;
+	load_step_delay();
+	TA2CCTL0 = CCIE;
+	TA2CTL   = TASSEL_2 | MC_1 | TACLR;
+
+	return;
+}
+//============================================================================
 
-		delay_10us( accel_delay[accel_it] );
 
-		P3OUT &= ~BIT6; // Reset step pin
 
-		delay_10us( accel_delay[accel_it] );
+/*home_step
+* Homing half of the step interrupt - steps the axis being homed until its
+*   switch reads closed, then stops for service_homing() to debounce it
+* INPUT: None
+* RETURN: None
+*/
+static void home_step( void )
+{
+	uint8_t closed;
 
+	if( step_high == FALSE )
+	{
+		if( home_state == HOME_X_SEEK ) { X_STEP_HIGH(); }
+		else                            { Y_STEP_HIGH(); }
 
-		if(Y<Ynew)
-		{
-			Y += PXL2TCK;
-		}
-		else
-		{
-			Y -= PXL2TCK;
-		}
+		step_high = TRUE;
+	}
+	else
+	{
+		X_STEP_LOW();
+		Y_STEP_LOW();
+		step_high = FALSE;
+
+		closed = ( home_state == HOME_X_SEEK ) ? X_HOME_CLOSED() : Y_HOME_CLOSED();
 
-		if( ( i % repeat_it ) == ( repeat_it - 1 ) )
+		if( closed )
 		{
-			if( i < ( num_accel_it - 1 ) )
-			{
-				accel_it += it_skip;
-			}
-			else if( i > ( yDiff - num_accel_it - 1 ) )
-			{
-				accel_it -= it_skip;
-			}
+			TA2CCTL0 = 0;
+			TA2CTL   = TASSEL_2 | TACLR;
+
+			home_check_end = time_ms + HOME_DEBOUNCE_MS;
+			home_state++;
+
+			POST_EVENT_FROM_ISR( EV_MOTION );
+			return;
 		}
 	}
 
-	Y = Ynew;
-	/////////////////////////////////////////////////////////
-
+	step_delay_left = HOME_TCK_DELAY;
+	load_step_delay();
 
-	return 0;
+	return;
 }
-#endif
 //============================================================================
 
 
 
-#ifdef DEBUG
-void homeLaser(void){
-
-	uint16_t i = 0;
-	uint16_t trig_count = 0;
+/*start_homing
+* Starts moving the laser to the home position, X then Y. Returns straight
+*   away, service_homing() carries it on (nothing may be queued)
+* INPUT: None
+* RETURN: None
+*/
+void start_homing( void )
+{
+	__disable_interrupt();
 
-	///////////////Set Direction Negative//////////
-	P4OUT &= ~BIT0;  //negative X direction
-    P8OUT &= ~BIT2;  //negative Y direction
-	/////////////////////////////////////////////////
+	ENABLE_DRIVERS();
+	X_DIR_NEGATIVE();
+	Y_DIR_NEGATIVE();
 
+	home_seek( HOME_X_SEEK );
 
-	while( homeX == 1 )
-	{
-		if( debounce_xhome == TRUE )
-		{
-			P2IE &= ~BIT0;
-			delay_ms( 5 );
+	__enable_interrupt();
 
-			/*for( i = 0; i < 100; i++ )
-			{
-				if( !( P2IN & BIT0 ) )
-				{
-					trig_count++
-			}*/
-
-			if( !( P2IN & BIT0 ) )
-			{
-				homeX = 0;
-				X = 0;
-			}
-			else
-			{
-				debounce_xhome = FALSE;
-			}
-		}
+	return;
+}
+//============================================================================
 
-		//P4OUT &= ~BIT0; //negative direction ONLY FOR LAUNCHPAD TESTING
-		P4OUT |= BIT3;  //set step pin ONLY FOR LAUNCHPAD TESTING
 
-		delay_10us( TCK_DELAY );
 
-		P4OUT &= ~BIT3; //reset step pin
+/*service_homing
+* Carries on homing - once the step interrupt has found a switch closed, checks
+*   it is still closed after the debounce time, then moves on to the next axis
+*   (or back to stepping if it bounced)
+* INPUT: None
+* RETURN: TRUE while homing, FALSE once the head is home
+*/
+uint8_t service_homing( void )
+{
+	uint8_t closed;
 
-		delay_10us( TCK_DELAY );
+	if( home_state != HOME_X_CHECK && home_state != HOME_Y_CHECK )
+	{
+		return ( home_state != HOME_IDLE ) ? TRUE : FALSE;
 	}
 
-
-
-	while (homeY==1)
+	if( (int32_t)( time_ms - home_check_end ) < 0 )
 	{
-		if( debounce_yhome == TRUE )
-		{
-			P2IE  &= ~BIT1;
+		return TRUE;
+	}
 
-			delay_ms( 5 );
-			if( !( P2IN & BIT1 ) )
-			{
-				homeY = 0;
-				Y = 0;
-			}
-			else
-			{
-				debounce_yhome = FALSE;
-			}
-		}
+	closed = ( home_state == HOME_X_CHECK ) ? X_HOME_CLOSED() : Y_HOME_CLOSED();
 
-		// P8OUT &= ~BIT2;  // Negative direction ONLY FOR LAUNCHPAD TESTING
-		P3OUT |= BIT7;   // Set step pin ONLY FOR LAUNCHPAD TESTING
+	__disable_interrupt();
 
-		delay_10us( TCK_DELAY );
+	if( closed == FALSE )
+	{
+		// Switch bounced - keep going
+		home_seek( home_state - 1 );
+	}
+	else if( home_state == HOME_X_CHECK )
+	{
+		xPos = 0;
+		home_seek( HOME_Y_SEEK );
+	}
+	else
+	{
+		yPos = 0;
+		DISABLE_DRIVERS();
 
-		P3OUT &= ~BIT7; //reset step pin
+		// Queued moves start from home
+		xPlan = xPos;
+		yPlan = yPos;
 
-		delay_10us( TCK_DELAY );
+		home_state = HOME_IDLE;
 	}
 
-	P6OUT &= ~BIT0;  //reset drivers LAUNCHPAD
-	P6OUT |= BIT1;  //disable drivers LAUNCHPAD
+	__enable_interrupt();
+
+	return ( home_state != HOME_IDLE ) ? TRUE : FALSE;
 }
+//============================================================================
 
+////////////////////////////////////////////////////////////////////////////////
 
-#else
-void homeLaser(void){
 
-	///////////////Set Direction Negative//////////
-	P4OUT |= BIT6;  //unreset drivers
-	P7OUT &= ~BIT6; //enable drivers
 
-	P7OUT |= BIT7;  //negative X direction
-    P4OUT |= BIT0;  //negative Y direction
-	/////////////////////////////////////////////////
+/*TIMERA2_ISR
+* Step engine. Each interrupt ends one half of a tick: the rising edge steps the
+*   major axis (and the minor one when the Bresenham error overflows), the
+*   falling edge updates the position, advances the acceleration and moves on
+*   to the next segment when this one is done
+*/
+#pragma vector = TIMER2_A0_VECTOR
+__interrupt void TIMERA2_ISR(void)
+{
+	uint16_t delay;
+	PROF_ENTER( PROF_ISR_STEP );
 
-    if( !( P2IN & BIT0 ) )
-    {
-    	delay_ms( 20 );
+	if( step_delay_left > 0 )
+	{
+		load_step_delay();
+		PROF_EXIT( PROF_ISR_STEP );
+		return;
+	}
 
-		if( !( P2IN & BIT0 ) )
-		{
-			// Interrupt was true - homing end
-			homeX = 0;
-			X = 0;
-		}
-    }
+	if( home_state != HOME_IDLE )
+	{
+		home_step();
+		PROF_EXIT( PROF_ISR_STEP );
+		return;
+	}
 
-    // If not already at home, enable the interrupt and home
-    if( homeX == 1 )
-    {
-    	 // Enable interrupts
-    	 P2IE |= BIT0;
-    }
+	delay = ( seg_delay != 0 ) ? seg_delay : (uint16_t)accel_delay[accel_it];
 
-	while( homeX == 1 )
+	if( step_high == FALSE )
 	{
-		if( debounce_xhome == TRUE )
-		{
-			P2IE  &= ~BIT0;
-			delay_ms( 5 );
-
-			if( !( P2IN & BIT0 ) )
-			{
-				// Interrupt was true - homing end
-				homeX = 0;
-				X = 0;
-			}
-			else
-			{
-				// Interrupt was false - wait for another
-				debounce_xhome = FALSE;
-				P2IE |= BIT0;
-			}
-		}
-		else
+		// The lid interlock has tripped - hold every move here (between ticks)
+		//   until the lid is closed and the Pi resumes, so nothing moves with
+		//   the lid up and a line cut by the interlock has no gap
+		if( lid_hold == TRUE )
 		{
-			//P7OUT &= ~BIT7; //negative direction
-			P7OUT |= BIT5;  //set step pin
-
-			delay_10us( HOME_TCK_DELAY );
-
-			P7OUT &= ~BIT5;
-
-			delay_10us( HOME_TCK_DELAY );
+			step_delay_left = delay;
+			load_step_delay();
+			PROF_EXIT( PROF_ISR_STEP );
+			return;
 		}
-	}
-
 
+		seg_minor_step = FALSE;
+		seg_error -= seg_minor;
 
-	// Y-Axis Homing
-    if( !( P2IN & BIT1 ) )
-    {
-    	delay_ms( 20 );
-
-		if( !( P2IN & BIT1 ) )
+		if( seg_error < 0 )
 		{
-			// Interrupt was true - homing end
-			homeY = 0;
-			Y = 0;
+			seg_error += seg_major;
+			seg_minor_step = TRUE;
 		}
-    }
-
-    // If not already at home, enable the interrupt and home
-    if( homeY == 1 )
-    {
-    	 // Enable interrupts
-    	 P2IE |= BIT1;
-    }
 
+		if( seg_x_major == TRUE || seg_minor_step == TRUE ) { X_STEP_HIGH(); }
+		if( seg_x_major == FALSE || seg_minor_step == TRUE ) { Y_STEP_HIGH(); }
 
-	while( homeY == 1 )
+		step_high = TRUE;
+	}
+	else
 	{
-		if( debounce_yhome == TRUE )
+		X_STEP_LOW();
+		Y_STEP_LOW();
+
+		if( seg_x_major == TRUE || seg_minor_step == TRUE ) { xPos += seg_x_dir; }
+		if( seg_x_major == FALSE || seg_minor_step == TRUE ) { yPos += seg_y_dir; }
+
+		// Ramp up over the first ticks and back down over the last (the low half
+		//   of this tick still uses the delay it started with)
+		if( seg_delay == 0 && ++repeat_count == repeat_it )
 		{
-			P2IE  &= ~BIT1;
+			repeat_count = 0;
 
-			delay_ms( 5 );
-			if( !( P2IN & BIT1 ) )
+			if( seg_it < ( num_accel_it - 1 ) )
 			{
-				// Interrupt was true - homing end
-				homeY = 0;
-				Y = 0;
+				accel_it++;
 			}
-			else
+			else if( (uint32_t)seg_it + num_accel_it >= seg_major && accel_it > 0 )
 			{
-				// Interrupt was false - wait for another
-				debounce_yhome = FALSE;
-				P2IE |= BIT1;
+				accel_it--;
 			}
 		}
-		else
-		{
-			// P4OUT &= ~BIT0; // Negative direction
-			P3OUT |= BIT6;  // Set step pin
 
-			delay_10us( HOME_TCK_DELAY );
+		seg_it++;
+		step_high = FALSE;
 
-			P3OUT &= ~BIT6; //reset step pin
+		if( seg_it >= seg_major )
+		{
+			if( start_next_segment() == FALSE )
+			{
+				// Queue has run dry
+				TA2CCTL0 = 0;
+				TA2CTL   = TASSEL_2 | TACLR;
+				motion_running = FALSE;
+
+				POST_EVENT_FROM_ISR( EV_MOTION );
+				PROF_EXIT( PROF_ISR_STEP );
+				return;
+			}
 
-			delay_10us( HOME_TCK_DELAY );
 		}
 	}
 
-	P4OUT &= ~BIT6;  //reset drivers
-	P7OUT |= BIT6;  //disable drivers
-	
-	// Turn the interrupts off
-	P2IE  &= ~BIT0;
-	P2IE  &= ~BIT1;
+	step_delay_left = delay;
+	load_step_delay();
+
+	PROF_EXIT( PROF_ISR_STEP );
 }
-#endif
 //============================================================================
 
-////////////////////////////////////////////////////////////////////////////////
-
 
 
 
@@ -692,7 +818,7 @@ __interrupt void Port_2(void)
 
 		P4OUT &= ~BIT3; //stop stepping
 		homeX = 0;
-		X = 0;
+		xPos = 0;
 		P2IFG &= ~BIT0; // P2.0 IFG cleared
 	}
 
@@ -700,7 +826,7 @@ __interrupt void Port_2(void)
 
 		P3OUT &= ~BIT7; //stop stepping
 		homeY = 0;
-		Y = 0;
+		yPos = 0;
 		P2IFG &= ~BIT2; // P2.2 IFG cleared
 	}
 
@@ -717,6 +843,7 @@ __interrupt void Port_2(void)
 __interrupt void PORT_2_ISR(void)
 {
 	volatile uint16_t fuck_all_the_things = P2IV;
+	PROF_ENTER( PROF_ISR_PORT2 );
 
 	//unsigned int flag = (P1IFG & P1IE);
 	if( fuck_all_the_things & P2IV_P2IFG0 ){   //XHOME P2.0 interrupt
@@ -743,6 +870,8 @@ __interrupt void PORT_2_ISR(void)
 
 		P2IFG &= ~BIT1; // P2.2 IFG cleared
 	}
+
+	PROF_EXIT( PROF_ISR_PORT2 );
 }
 #endif
 
@@ -30,32 +30,67 @@ P4.7 is an output (on launchpad this controls an LED)
 void initMotorIO(void);
 
 
-/*moveMotors
+/*initStepTimer
 
-* moves x-axis motor then moves y-axis motors
+* sets up timer A2, which times the step pulses for queued moves
 
-*Need to add y-axis logic. simply copy x axis but with y coordinate
-
-* INPUT: Xnew and Ynew both unsigned ints
+* INPUT: None
 
 * RETURN: None
 
 */
+void initStepTimer(void);
+
+
+/*queue_move, queue_move_linear
+
+* queue a move for the step interrupt and return straight away (targets in ticks).
+* queue_move runs x then y with acceleration, queue_move_linear runs both axes
+* together at a fixed tick delay. EV_MOTION is posted when the queue runs dry
+
+* INPUT: Xnew and Ynew in ticks, tck_delay is the delay (10 us) for each tick high and low
+
+* RETURN: TRUE if queued, FALSE if the queue is full
+
+*/
+uint8_t queue_move(uint32_t Xnew, uint32_t Ynew);
+uint8_t queue_move_linear(uint32_t Xnew, uint32_t Ynew, uint16_t tck_delay);
+
+
+/*motion_busy
 
-uint8_t moveMotors(unsigned int Xnew, unsigned int Ynew);
+* RETURN: TRUE while any queued move has yet to finish
+
+*/
+uint8_t motion_busy(void);
 
 
-/*homeLaser
+/*motion_stop
 
-* moves laser to the home position 
-* uses launchpad pins need to change to Port 7
+* stops stepping immediately and drops every queued move
 
-* INPUT: none
+* INPUT: None
 
 * RETURN: None
 
 */
-void homeLaser(void);
+void motion_stop(void);
+
+
+/*start_homing, service_homing
+
+* move the laser to the home position, x then y. start_homing returns straight
+* away, service_homing carries it on and must be called until it returns FALSE.
+* EV_MOTION is posted each time a home switch is reached. Nothing may be queued
+* while homing
+
+* INPUT: None
+
+* RETURN: service_homing - TRUE while homing, FALSE once home
+
+*/
+void start_homing(void);
+uint8_t service_homing(void);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -0,0 +1,128 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : profile.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-28 (Created), 2015-04-28 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Source code for the hot path profile. Each section bracketed
+//				 by PROF_ENTER / PROF_EXIT keeps its min, max and average
+//				 run time in CPU cycles (Timer B0 counts SMCLK when PROFILE
+//				 is defined). The Pi reads the table with CMD_PROFILE.
+//				 Only built when PROFILE is defined.
+//============================================================================
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "hal.h"
+#include "defs.h"
+#include "profile.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#ifdef PROFILE
+
+static struct TProf_Entry prof_table[PROF_COUNT];
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*prof_record
+* Adds one run of a section to its entry. Called from interrupts as well, so
+*   the update is done with them disabled
+* INPUT: Section (PROF_x), cycles it took
+* RETURN: None
+*/
+void prof_record( uint8_t id, uint32_t cycles )
+{
+	struct TProf_Entry * entry = &prof_table[id];
+	uint16_t state = __get_interrupt_state();
+
+	__disable_interrupt();
+
+	if( entry->count == 0 || cycles < entry->min ) { entry->min = cycles; }
+	if( cycles > entry->max )                      { entry->max = cycles; }
+
+	// Halve the sum and count rather than let either wrap - the average holds
+	if( entry->count == UINT16_MAX || entry->total > UINT32_MAX - cycles )
+	{
+		entry->total >>= 1;
+		entry->count >>= 1;
+	}
+
+	entry->total += cycles;
+	entry->count++;
+
+	__set_interrupt_state( state );
+
+	return;
+}
+//============================================================================
+
+
+
+/*prof_get
+* Reads one field of the table, for sending to the Pi
+* INPUT: Index (PROF_x * PROF_FIELDS + PROF_FIELD_x)
+* RETURN: Its value (cycles, or runs for PROF_FIELD_COUNT)
+*/
+uint32_t prof_get( uint8_t index )
+{
+	struct TProf_Entry entry;
+	uint16_t state = __get_interrupt_state();
+
+	if( index >= PROF_COUNT * PROF_FIELDS )
+	{
+		return 0;
+	}
+
+	__disable_interrupt();
+	entry = prof_table[ index / PROF_FIELDS ];
+	__set_interrupt_state( state );
+
+	switch( index % PROF_FIELDS )
+	{
+		case PROF_FIELD_COUNT : return entry.count;
+		case PROF_FIELD_MIN   : return entry.min;
+		case PROF_FIELD_MAX   : return entry.max;
+		default				  : return ( entry.count > 0 ) ? entry.total / entry.count : 0;
+	}
+}
+//============================================================================
+
+
+
+/*prof_reset
+* Clears the table
+* INPUT: None
+* RETURN: None
+*/
+void prof_reset( void )
+{
+	uint8_t i;
+	uint16_t state = __get_interrupt_state();
+
+	__disable_interrupt();
+
+	for( i = 0; i < PROF_COUNT; i++ )
+	{
+		prof_table[i].min   = 0;
+		prof_table[i].max   = 0;
+		prof_table[i].total = 0;
+		prof_table[i].count = 0;
+	}
+
+	__set_interrupt_state( state );
+
+	return;
+}
+//============================================================================
+
+#endif // PROFILE
+
+////////////////////////////////////////////////////////////////////////////////
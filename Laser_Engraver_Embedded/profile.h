@@ -0,0 +1,69 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : profile.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-28 (Created), 2015-04-28 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Header file including the enter / exit macros and function
+//				 prototypes used for profiling the hot paths. Everything here
+//				 compiles to nothing unless PROFILE is defined (see defs.h)
+//============================================================================
+
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "defs.h"
+#include "time.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*TProf_Entry
+* Cycle counts of one profiled section (PROF_x)
+*/
+struct TProf_Entry
+{
+	uint32_t min;
+	uint32_t max;
+	uint32_t total;					// Sum of the counted runs (halved with count, see prof_record)
+	uint16_t count;					// Runs counted
+};
+
+
+#ifdef PROFILE
+
+/*PROF_ENTER / PROF_EXIT
+* Bracket a profiled section. PROF_ENTER declares the start time, so it goes
+*   after the declarations of the block, and every way out of the block needs
+*   a PROF_EXIT with the same id. Interrupts taken inside the section are
+*   counted in it
+*/
+#define PROF_ENTER( id )	uint32_t prof_start_##id = tstamp_now()
+#define PROF_EXIT( id )		prof_record( id, tstamp_now() - prof_start_##id )
+
+#else
+
+#define PROF_ENTER( id )
+#define PROF_EXIT( id )
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+void prof_record( uint8_t id, uint32_t cycles );
+uint32_t prof_get( uint8_t index );
+void prof_reset( void );
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // PROFILE_H_
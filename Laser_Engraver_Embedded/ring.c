@@ -0,0 +1,203 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : ring.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-22 (Created), 2015-04-22 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Source code for the single-producer / single-consumer ring
+//				 buffers. The producer only writes the tail and the consumer
+//				 only writes the head, and each 16-bit write is atomic, so an
+//				 interrupt and the main program can share a ring without
+//				 locking.
+//============================================================================
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "defs.h"
+#include "ring.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+/*ring_init
+* Sets up an empty ring over a buffer
+* INPUT: Ring, buffer of size * elem_size bytes, size in elements (power of 2),
+*   and bytes per element
+* RETURN: None
+*/
+void ring_init( struct TRing * ring, volatile void * buf, uint16_t size, uint16_t elem_size )
+{
+	ring->buf       = (volatile uint8_t *)buf;
+	ring->mask      = size - 1;
+	ring->elem_size = elem_size;
+	ring->head      = 0;
+	ring->tail      = 0;
+
+	return;
+}
+//============================================================================
+
+
+
+/*ring_count
+* INPUT: Ring
+* RETURN: Number of elements waiting to be taken out (either side may call it)
+*/
+uint16_t ring_count( const struct TRing * ring )
+{
+	return (uint16_t)( ring->tail - ring->head );
+}
+//============================================================================
+
+
+
+/*ring_free
+* INPUT: Ring
+* RETURN: Number of elements that can be put in (either side may call it)
+*/
+uint16_t ring_free( const struct TRing * ring )
+{
+	return ( ring->mask + 1 ) - (uint16_t)( ring->tail - ring->head );
+}
+//============================================================================
+
+
+
+/*ring_write
+* Copies an element into the slot offset elements past the tail without making
+*   it visible to the consumer (see ring_commit). The caller must have checked
+*   ring_free() - producer only
+* INPUT: Ring, slot offset past the tail, element to copy in
+* RETURN: None
+*/
+void ring_write( struct TRing * ring, uint16_t offset, const void * elem )
+{
+	volatile uint8_t * slot = &ring->buf[ ( ( ring->tail + offset ) & ring->mask ) * ring->elem_size ];
+	const uint8_t * src = (const uint8_t *)elem;
+	uint16_t i;
+
+	for( i = 0; i < ring->elem_size; i++ )
+	{
+		slot[i] = src[i];
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*ring_commit
+* Hands the next n written elements to the consumer with a single tail update,
+*   so it never sees part of a group - producer only
+* INPUT: Ring, number of elements
+* RETURN: None
+*/
+void ring_commit( struct TRing * ring, uint16_t n )
+{
+	ring->tail += n;
+
+	return;
+}
+//============================================================================
+
+
+
+/*ring_push
+* Copies an element in and hands it to the consumer - producer only
+* INPUT: Ring, element to copy in
+* RETURN: TRUE if added, FALSE if the ring is full
+*/
+uint8_t ring_push( struct TRing * ring, const void * elem )
+{
+	if( ring_free( ring ) == 0 )
+	{
+		return FALSE;
+	}
+
+	ring_write( ring, 0, elem );
+	ring_commit( ring, 1 );
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*ring_peek
+* Copies out the element offset elements past the head without removing it.
+*   The caller must have checked ring_count() - consumer only
+* INPUT: Ring, element offset past the head, where to copy the element
+* RETURN: None
+*/
+void ring_peek( const struct TRing * ring, uint16_t offset, void * elem )
+{
+	volatile uint8_t * slot = &ring->buf[ ( ( ring->head + offset ) & ring->mask ) * ring->elem_size ];
+	uint8_t * dst = (uint8_t *)elem;
+	uint16_t i;
+
+	for( i = 0; i < ring->elem_size; i++ )
+	{
+		dst[i] = slot[i];
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*ring_release
+* Gives the oldest n elements back to the producer - consumer only
+* INPUT: Ring, number of elements
+* RETURN: None
+*/
+void ring_release( struct TRing * ring, uint16_t n )
+{
+	ring->head += n;
+
+	return;
+}
+//============================================================================
+
+
+
+/*ring_pop
+* Takes the oldest element out - consumer only
+* INPUT: Ring, where to copy the element
+* RETURN: TRUE if an element was taken, FALSE if the ring is empty
+*/
+uint8_t ring_pop( struct TRing * ring, void * elem )
+{
+	if( ring->head == ring->tail )
+	{
+		return FALSE;
+	}
+
+	ring_peek( ring, 0, elem );
+	ring_release( ring, 1 );
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*ring_clear
+* Drops everything waiting - consumer only (or with the consumer stopped)
+* INPUT: Ring
+* RETURN: None
+*/
+void ring_clear( struct TRing * ring )
+{
+	ring->head = ring->tail;
+
+	return;
+}
+//============================================================================
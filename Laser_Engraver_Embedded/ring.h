@@ -0,0 +1,63 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : ring.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-22 (Created), 2015-04-22 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Header file including function prototypes and macros used for
+//				 the single-producer / single-consumer ring buffers shared
+//				 between the interrupts and the main program
+//============================================================================
+
+
+#ifndef RING_H_
+#define RING_H_
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*TRing
+* One side fills the ring and the other empties it. Each index is written by
+*   one side only and both run free (masked on access), so neither side has to
+*   disable interrupts and no full / empty flags are shared.
+* The size must be a power of 2.
+*/
+struct TRing
+{
+	volatile uint8_t * buf;			// size * elem_size bytes
+	uint16_t mask;					// Size (elements) - 1
+	uint16_t elem_size;				// Bytes per element
+	volatile uint16_t head;			// Oldest element (written by the consumer only)
+	volatile uint16_t tail;			// Next free slot (written by the producer only)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+void ring_init( struct TRing * ring, volatile void * buf, uint16_t size, uint16_t elem_size );
+
+uint16_t ring_count( const struct TRing * ring );
+uint16_t ring_free ( const struct TRing * ring );
+
+// Producer side
+void    ring_write ( struct TRing * ring, uint16_t offset, const void * elem );
+void    ring_commit( struct TRing * ring, uint16_t n );
+uint8_t ring_push  ( struct TRing * ring, const void * elem );
+
+// Consumer side
+void    ring_peek   ( const struct TRing * ring, uint16_t offset, void * elem );
+void    ring_release( struct TRing * ring, uint16_t n );
+uint8_t ring_pop    ( struct TRing * ring, void * elem );
+void    ring_clear  ( struct TRing * ring );
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // RING_H_
@@ -0,0 +1,110 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : scheduler.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-20 (Created), 2015-04-20 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Source code for the run-to-completion task scheduler. The
+//				 interrupts only flag events, each task runs when one of its
+//				 events is pending and returns without waiting on anything.
+//				 With nothing to do, the CPU sleeps in LPM0.
+//============================================================================
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "hal.h"
+#include "defs.h"
+#include "scheduler.h"
+#include "uart_fifo.h"
+#include "laser_driver.h"
+#include "job.h"
+#include "bytecode.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+struct TTask
+{
+	uint16_t events;				// Events the task runs on
+	void ( *handler )( void );
+};
+
+
+// Tasks run in this order for every batch of events
+static const struct TTask tasks[] =
+{
+	{ EV_LID | EV_TICK,										safety_task },
+	{ EV_UART_RX | EV_TICK,									comm_task   },
+	{ EV_BURN | EV_TICK,									job_task    },
+	{ EV_BURN | EV_TICK,									code_task   },
+	{ EV_UART_RX | EV_MOTION | EV_BURN | EV_LID | EV_TICK,	burn_task   },
+};
+
+#define NUM_TASKS	( sizeof( tasks ) / sizeof( tasks[0] ) )
+
+
+volatile uint16_t sched_events = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*post_event
+* Flags an event from the main context (interrupts use POST_EVENT_FROM_ISR)
+* INPUT: Event flags
+* RETURN: None
+*/
+void post_event( uint16_t events )
+{
+	__disable_interrupt();
+	sched_events |= events;
+	__enable_interrupt();
+
+	return;
+}
+//============================================================================
+
+
+
+/*run_scheduler
+* Never returns. Takes all pending events at once and runs every task waiting
+*   on any of them. Interrupts are disabled between checking for events and
+*   entering LPM0, so an event can't slip in unnoticed before sleeping.
+* INPUT: None
+* RETURN: None
+*/
+void run_scheduler( void )
+{
+	uint16_t events;
+	uint16_t i;
+
+	while( 1 )
+	{
+		__disable_interrupt();
+
+		events = sched_events;
+		sched_events = 0;
+
+		if( events == 0 )
+		{
+			// Sleep until an interrupt posts an event (GIE and CPUOFF set together)
+			__bis_SR_register( LPM0_bits | GIE );
+			continue;
+		}
+
+		__enable_interrupt();
+
+		for( i = 0; i < NUM_TASKS; i++ )
+		{
+			if( events & tasks[i].events )
+			{
+				tasks[i].handler();
+			}
+		}
+	}
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,53 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : scheduler.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-20 (Created), 2015-04-20 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Header file including function prototypes and macros used for
+//				 the run-to-completion task scheduler
+//============================================================================
+
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "hal.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Event flags (set by the interrupts, consumed by the scheduler)
+#define EV_UART_RX		BIT0		// A complete packet is waiting in the rx fifo
+#define EV_TICK			BIT1		// 1 ms timer tick
+#define EV_MOTION		BIT2		// Motion queue has run dry
+#define EV_BURN			BIT3		// Timed burn has finished
+#define EV_LID			BIT4		// Lid interlock changed state
+
+
+extern volatile uint16_t sched_events;
+
+
+/*POST_EVENT_FROM_ISR
+* Flags an event and wakes the CPU from LPM0 when the interrupt returns.
+*   Must be used directly in the interrupt routine (not in a function it calls)
+*/
+#define POST_EVENT_FROM_ISR( ev )	{ sched_events |= ( ev ); __bic_SR_register_on_exit( LPM0_bits ); }
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+void post_event( uint16_t events );
+void run_scheduler( void );
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // SCHEDULER_H_
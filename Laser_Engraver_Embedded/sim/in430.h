@@ -0,0 +1,48 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : in430.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Stands in for the compiler's in430.h in the host simulation.
+//				 The status register intrinsics are functions of the
+//				 simulation core (sim_core.c), which keeps GIE and the low
+//				 power mode bits and runs the interrupts
+//============================================================================
+
+
+#ifndef SIM_IN430_H_
+#define SIM_IN430_H_
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Interrupt routines are plain functions, called by the simulation core
+#define __interrupt
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+void __enable_interrupt( void );
+void __disable_interrupt( void );
+unsigned short __get_interrupt_state( void );
+void __set_interrupt_state( unsigned short state );
+
+void __bis_SR_register( unsigned short bits );
+void __bic_SR_register( unsigned short bits );
+void __bis_SR_register_on_exit( unsigned short bits );
+void __bic_SR_register_on_exit( unsigned short bits );
+
+void __delay_cycles( unsigned long cycles );
+void __no_operation( void );
+
+#define _BIS_SR( bits )					__bis_SR_register( bits )
+#define _BIC_SR( bits )					__bic_SR_register( bits )
+#define __even_in_range( value, max )	( value )
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // SIM_IN430_H_
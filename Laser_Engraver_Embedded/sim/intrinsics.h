@@ -0,0 +1,13 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : intrinsics.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Stands in for the compiler's intrinsics.h in the host
+//				 simulation (everything is in sim/in430.h)
+//============================================================================
+
+
+#include "in430.h"
@@ -0,0 +1,96 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : sim.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Header file including function prototypes and macros shared
+//				 by the parts of the host simulation (not used by the
+//				 firmware itself, which only sees sim_hal.h)
+//============================================================================
+
+
+#ifndef SIM_H_
+#define SIM_H_
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Virtual time is kept in SMCLK cycles. The firmware itself takes no time to
+//   run, time only passes while it sleeps or waits on an interrupt
+extern uint64_t sim_cycles;
+
+#define SIM_NEVER				UINT64_MAX
+
+#define SIM_US_TO_CYCLES( us )	( (uint64_t)( us ) * SMCLK_HZ / 1000000 )
+#define SIM_CYCLES_TO_US( cyc )	( (uint64_t)( cyc ) * 1000000 / SMCLK_HZ )
+
+#define SIM_BAUD				115200
+#define SIM_CHAR_CYCLES			( ( 10ULL * SMCLK_HZ + SIM_BAUD / 2 ) / SIM_BAUD )	// Start, 8 data, stop
+
+// Signals of the waveform file (sim_vcd.c)
+#define VCD_X_STEP				0
+#define VCD_X_DIR				1
+#define VCD_Y_STEP				2
+#define VCD_Y_DIR				3
+#define VCD_DRV_RESET			4
+#define VCD_DRV_ENABLE			5
+#define VCD_X_HOME				6
+#define VCD_Y_HOME				7
+#define VCD_LASER_PWM			8
+#define VCD_LASER_ENABLE		9
+#define VCD_FAN_ENABLE			10
+#define VCD_UART_TX				11
+#define VCD_UART_RX				12
+#define VCD_NUM_SIGNALS			13
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// sim_core.c
+void sim_core_reset( void );
+void sim_uart_send( const uint8_t * data, uint16_t length, uint32_t delay_us );
+void sim_fail( const char * reason );
+uint8_t sim_ta0_out1( void );
+
+// sim_regs.c
+void sim_regs_reset( void );
+
+// sim_io.c
+void sim_io_reset( int32_t x, int32_t y );
+void sim_io_sample( void );
+void sim_io_position( int32_t * x, int32_t * y );
+uint32_t sim_io_lost_steps( void );
+
+// sim_vcd.c
+uint8_t sim_vcd_open( const char * path );
+void sim_vcd_set( uint8_t signal, uint8_t value, uint64_t at );
+void sim_vcd_uart( uint8_t signal, uint8_t c, uint64_t start );
+void sim_vcd_flush( void );
+void sim_vcd_close( void );
+
+// sim_pi.c
+uint8_t sim_pi_load( const char * path );
+void sim_pi_pattern( uint16_t width, uint16_t height );
+void sim_pi_reset( uint32_t latency_us );
+void sim_pi_receive( uint8_t c );
+uint64_t sim_pi_next_event( void );
+void sim_pi_run( void );
+uint8_t sim_pi_done( void );
+uint64_t sim_pi_start_cycles( void );
+uint32_t sim_pi_sent( void );
+
+// sim_main.c
+void sim_check_done( void );
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // SIM_H_
@@ -0,0 +1,775 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : sim_core.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Core of the host simulation - virtual time, the status
+//				 register intrinsics, Timer_A0-A2 / Timer_B0 (with the CCR1
+//				 output that drives the laser's PWM), USCI_A1 and the
+//				 interrupts. Time moves on only while the firmware sleeps or
+//				 waits (HAL_IDLE), straight to the next hardware event
+//============================================================================
+
+
+#ifdef SIM
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hal.h"
+#include "defs.h"
+#include "sim.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Interrupt routines of the firmware
+void TIMERB0_ISR( void );
+void TIMERA0_ISR( void );
+void TIMERA1_ISR( void );
+void USCI0RXTX_ISR( void );
+void TIMERA2_ISR( void );
+void PORT_2_ISR( void );
+
+uint64_t sim_cycles = 0;
+
+static uint8_t gie    = FALSE;		// GIE bit of the status register
+static uint8_t in_isr = FALSE;		// An interrupt routine is running
+static uint8_t woken  = FALSE;		// An interrupt cleared CPUOFF on exit
+
+
+// Timer_A / Timer_B, clocked from SMCLK (the only source the firmware uses)
+struct TSim_Timer
+{
+	volatile unsigned int * ctl;
+	volatile unsigned int * r;
+	volatile unsigned int * ccr0;
+	volatile unsigned int * cctl0;
+	volatile unsigned int * ex0;
+	volatile unsigned int * ccr1;
+	volatile unsigned int * cctl1;
+	uint32_t sub;					// SMCLK cycles counted toward the next timer count
+	uint8_t  out1;					// CCR1 output (OUT bit or reset/set only)
+};
+
+static struct TSim_Timer timers[] =
+{
+	{ &TA0CTL, &TA0R, &TA0CCR0, &TA0CCTL0, &TA0EX0, &TA0CCR1, &TA0CCTL1, 0, 0 },
+	{ &TA1CTL, &TA1R, &TA1CCR0, &TA1CCTL0, &TA1EX0, &TA1CCR1, &TA1CCTL1, 0, 0 },
+	{ &TA2CTL, &TA2R, &TA2CCR0, &TA2CCTL0, &TA2EX0, &TA2CCR1, &TA2CCTL1, 0, 0 },
+	{ &TB0CTL, &TB0R, &TB0CCR0, &TB0CCTL0, &TB0EX0, &TB0CCR1, &TB0CCTL1, 0, 0 },
+};
+
+#define NUM_TIMERS		( sizeof( timers ) / sizeof( timers[0] ) )
+
+
+// Chars from the Pi, each with the cycle its stop bit ends
+#define SIM_RX_QUEUE_SIZE	4096	// Must be a power of 2
+
+static uint8_t  rx_queue[SIM_RX_QUEUE_SIZE];
+static uint64_t rx_time[SIM_RX_QUEUE_SIZE];
+static uint32_t rx_head;
+static uint32_t rx_tail;
+static uint64_t rx_line_free;		// Cycle the Pi's line is next free
+
+static uint8_t  tx_shifting;		// A char is in the transmit shift register
+static uint8_t  tx_shift_char;
+static uint64_t tx_shift_end;
+
+uint32_t sim_uart_overruns = 0;		// Received chars overwritten before they were read
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*sim_fail
+* Stops the simulation when the firmware has done something the hardware
+*   wouldn't allow (or the simulation can't model)
+* INPUT: Reason
+* RETURN: Never returns
+*/
+void sim_fail( const char * reason )
+{
+	fprintf( stderr, "sim: %s at %.6f s\n", reason, (double)sim_cycles / SMCLK_HZ );
+	sim_vcd_close();
+	exit( 2 );
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+static uint32_t timer_divider( struct TSim_Timer * t )
+{
+	return ( 1 << ( ( *t->ctl >> 6 ) & 0x03 ) ) * ( ( *t->ex0 & 0x07 ) + 1 );
+}
+//============================================================================
+
+
+
+/*timer_top
+* INPUT: Timer
+* RETURN: Count the timer rolls over after, 0 if it is stopped
+*/
+static uint32_t timer_top( struct TSim_Timer * t )
+{
+	if( ( *t->ctl & TASSEL_3 ) != TASSEL_2 )
+	{
+		return 0;
+	}
+
+	switch( *t->ctl & MC_3 )
+	{
+		case MC_1:
+		case MC_3: return *t->ccr0 & 0xFFFF;		// Up / up-down (taken as up)
+		case MC_2: return 0xFFFF;					// Continuous
+		default:   return 0;						// Stopped
+	}
+}
+//============================================================================
+
+
+
+/*timer_sync
+* Carries out a TACLR the firmware has written (the bit clears itself), and
+*   puts the OUT bit on the CCR1 output when it is in output mode 0
+* INPUT: Timer
+* RETURN: None
+*/
+static void timer_sync( struct TSim_Timer * t )
+{
+	if( *t->ctl & TACLR )
+	{
+		*t->ctl &= ~TACLR;
+		*t->r    = 0;
+		t->sub   = 0;
+	}
+
+	if( ( *t->cctl1 & OUTMOD_7 ) == OUTMOD_0 )
+	{
+		t->out1 = ( *t->cctl1 & OUT ) ? 1 : 0;
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*timer_next
+* INPUT: Timer
+* RETURN: SMCLK cycles until the timer next sets a flag, SIM_NEVER if stopped
+*/
+static uint64_t timer_next( struct TSim_Timer * t )
+{
+	uint32_t top = timer_top( t );
+	uint32_t r   = *t->r & 0xFFFF;
+	uint32_t ticks;
+
+	if( top == 0 )
+	{
+		return SIM_NEVER;
+	}
+
+	// Counting up to the top sets CCR0's flag (up mode), the count after it rolls
+	//   over and sets TAIFG. A count already past a lowered CCR0 rolls over next
+	ticks = ( r < top ) ? top - r : 1;
+
+	// Counting to CCR1 on the way sets its flag (and may switch its output)
+	if( ( *t->ccr1 & 0xFFFF ) > r && ( *t->ccr1 & 0xFFFF ) - r < ticks )
+	{
+		ticks = ( *t->ccr1 & 0xFFFF ) - r;
+	}
+
+	return (uint64_t)ticks * timer_divider( t ) - t->sub;
+}
+//============================================================================
+
+
+
+/*timer_run
+* Counts the timer on by a number of SMCLK cycles, setting its flags. In
+*   reset/set mode the CCR1 output is reset at CCR1 and set at 0
+* INPUT: Timer, cycles
+* RETURN: None
+*/
+static void timer_run( struct TSim_Timer * t, uint64_t cycles )
+{
+	uint32_t top  = timer_top( t );
+	uint32_t div  = timer_divider( t );
+	uint32_t r    = *t->r & 0xFFFF;
+	uint32_t ccr1 = *t->ccr1 & 0xFFFF;
+	uint8_t  pwm  = ( ( *t->cctl1 & OUTMOD_7 ) == OUTMOD_7 ) ? TRUE : FALSE;
+	uint64_t ticks;
+	uint32_t stop;
+	uint32_t n;
+
+	if( top == 0 )
+	{
+		return;
+	}
+
+	ticks  = ( t->sub + cycles ) / div;
+	t->sub = ( t->sub + cycles ) % div;
+
+	while( ticks > 0 )
+	{
+		if( r >= top )
+		{
+			r = 0;
+			*t->ctl |= TAIFG;
+			ticks--;
+
+			if( pwm == TRUE ) { t->out1 = ( ccr1 == 0 ) ? 0 : 1; }
+		}
+		else
+		{
+			stop = ( ccr1 > r && ccr1 < top ) ? ccr1 : top;
+
+			n = ( ticks < stop - r ) ? (uint32_t)ticks : stop - r;
+			r += n;
+			ticks -= n;
+
+			if( r == ccr1 )
+			{
+				*t->cctl1 |= CCIFG;
+
+				if( pwm == TRUE ) { t->out1 = 0; }
+			}
+
+			if( r == top && ( *t->ctl & MC_3 ) != MC_2 )
+			{
+				*t->cctl0 |= CCIFG;
+			}
+		}
+	}
+
+	*t->r = r;
+
+	return;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*sim_uart_send
+* Puts chars on the line from the Pi to the MSP. They follow whatever the Pi
+*   is still sending, back to back at the baud rate
+* INPUT: Chars, count, and delay (us) before the first one starts
+* RETURN: None
+*/
+void sim_uart_send( const uint8_t * data, uint16_t length, uint32_t delay_us )
+{
+	uint64_t start = sim_cycles + SIM_US_TO_CYCLES( delay_us );
+	uint16_t i;
+
+	if( rx_line_free > start )
+	{
+		start = rx_line_free;
+	}
+
+	for( i = 0; i < length; i++ )
+	{
+		if( rx_tail - rx_head >= SIM_RX_QUEUE_SIZE )
+		{
+			sim_fail( "Pi has too many chars queued" );
+		}
+
+		sim_vcd_uart( VCD_UART_RX, data[i], start );
+		start += SIM_CHAR_CYCLES;
+
+		rx_queue[rx_tail & ( SIM_RX_QUEUE_SIZE - 1 )] = data[i];
+		rx_time[rx_tail & ( SIM_RX_QUEUE_SIZE - 1 )]  = start;
+		rx_tail++;
+	}
+
+	rx_line_free = start;
+
+	return;
+}
+//============================================================================
+
+
+
+/*sim_ta0_out1
+* INPUT: None
+* RETURN: Level of Timer_A0's CCR1 output (TA0.1, the laser's PWM)
+*/
+uint8_t sim_ta0_out1( void )
+{
+	return timers[0].out1;
+}
+//============================================================================
+
+
+
+/*uart_load
+* Moves a char the firmware has written to UCA1TXBUF (TXIFG reads clear) into
+*   the shift register, which empties the buffer again
+* INPUT: None
+* RETURN: None
+*/
+static void uart_load( void )
+{
+	if( tx_shifting == FALSE && ( UCA1IFG & UCTXIFG ) == 0 && ( UCA1CTL1 & UCSWRST ) == 0 )
+	{
+		tx_shifting   = TRUE;
+		tx_shift_char = UCA1TXBUF;
+		tx_shift_end  = sim_cycles + SIM_CHAR_CYCLES;
+
+		sim_vcd_uart( VCD_UART_TX, tx_shift_char, sim_cycles );
+
+		UCA1IFG |= UCTXIFG;
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*uart_next
+* INPUT: None
+* RETURN: Cycle of the next char to finish in either direction, SIM_NEVER if none
+*/
+static uint64_t uart_next( void )
+{
+	uint64_t next = SIM_NEVER;
+
+	if( rx_head != rx_tail )
+	{
+		next = rx_time[rx_head & ( SIM_RX_QUEUE_SIZE - 1 )];
+	}
+
+	if( tx_shifting == TRUE && tx_shift_end < next )
+	{
+		next = tx_shift_end;
+	}
+
+	return next;
+}
+//============================================================================
+
+
+
+/*uart_run
+* Finishes the chars due by now - a received one goes to UCA1RXBUF, a sent one
+*   to the Pi
+* INPUT: None
+* RETURN: None
+*/
+static void uart_run( void )
+{
+	while( rx_head != rx_tail && rx_time[rx_head & ( SIM_RX_QUEUE_SIZE - 1 )] <= sim_cycles )
+	{
+		if( UCA1IFG & UCRXIFG )
+		{
+			sim_uart_overruns++;
+		}
+
+		UCA1RXBUF = rx_queue[rx_head & ( SIM_RX_QUEUE_SIZE - 1 )];
+		UCA1IFG  |= UCRXIFG;
+		rx_head++;
+	}
+
+	if( tx_shifting == TRUE && tx_shift_end <= sim_cycles )
+	{
+		tx_shifting = FALSE;
+		sim_pi_receive( tx_shift_char );
+	}
+
+	uart_load();
+
+	return;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*sim_sync
+* Brings the simulation up to date with what the firmware has written since
+*   it last ran
+* INPUT: None
+* RETURN: None
+*/
+static void sim_sync( void )
+{
+	uint16_t i;
+
+	for( i = 0; i < NUM_TIMERS; i++ )
+	{
+		timer_sync( &timers[i] );
+	}
+
+	uart_load();
+	sim_io_sample();
+
+	return;
+}
+//============================================================================
+
+
+
+static void run_isr( void ( *isr )( void ) )
+{
+	in_isr = TRUE;
+	gie    = FALSE;
+
+	isr();
+
+	gie    = TRUE;				// RETI restores the status register
+	in_isr = FALSE;
+
+	sim_sync();
+
+	return;
+}
+//============================================================================
+
+
+
+/*dispatch_one
+* Runs the highest priority interrupt pending, clearing its flag as reading
+*   the vector register (or the buffer) would
+* INPUT: None
+* RETURN: TRUE if an interrupt was run
+*/
+static uint8_t dispatch_one( void )
+{
+	uint8_t bit;
+
+	if( ( TB0CTL & TBIE ) && ( TB0CTL & TBIFG ) )
+	{
+		TB0CTL &= ~TBIFG;
+		TB0IV   = TB0IV_TBIFG;
+		run_isr( TIMERB0_ISR );
+	}
+	else if( ( TA0CTL & TAIE ) && ( TA0CTL & TAIFG ) )
+	{
+		TA0CTL &= ~TAIFG;
+		TA0IV   = TA0IV_TAIFG;
+		run_isr( TIMERA0_ISR );
+	}
+	else if( ( TA1CCTL0 & CCIE ) && ( TA1CCTL0 & CCIFG ) )
+	{
+		TA1CCTL0 &= ~CCIFG;
+		run_isr( TIMERA1_ISR );
+	}
+	else if( UCA1IE & UCA1IFG & UCRXIFG )
+	{
+		UCA1IFG &= ~UCRXIFG;
+		UCA1IV   = USCI_UCRXIFG;
+		run_isr( USCI0RXTX_ISR );
+	}
+	else if( UCA1IE & UCA1IFG & UCTXIFG )
+	{
+		UCA1IFG &= ~UCTXIFG;
+		UCA1IV   = USCI_UCTXIFG;
+		run_isr( USCI0RXTX_ISR );
+	}
+	else if( ( TA2CCTL0 & CCIE ) && ( TA2CCTL0 & CCIFG ) )
+	{
+		TA2CCTL0 &= ~CCIFG;
+		run_isr( TIMERA2_ISR );
+	}
+	else if( P2IE & P2IFG )
+	{
+		for( bit = 0; ( ( P2IE & P2IFG ) & ( 1 << bit ) ) == 0; bit++ );
+
+		P2IFG &= ~( 1 << bit );
+		P2IV   = 2 * ( bit + 1 );
+		run_isr( PORT_2_ISR );
+	}
+	else
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*dispatch
+* Runs every pending interrupt, if interrupts are enabled
+* INPUT: None
+* RETURN: TRUE if any were run
+*/
+static uint8_t dispatch( void )
+{
+	uint8_t ran = FALSE;
+
+	if( gie == FALSE || in_isr == TRUE )
+	{
+		return FALSE;
+	}
+
+	sim_sync();
+
+	while( dispatch_one() == TRUE )
+	{
+		ran = TRUE;
+	}
+
+	return ran;
+}
+//============================================================================
+
+
+
+/*advance
+* Moves virtual time on to the next hardware event (or the limit, if sooner)
+*   and updates the peripherals to it
+* INPUT: Latest cycle to move on to
+* RETURN: None
+*/
+static void advance( uint64_t limit )
+{
+	uint64_t next = limit;
+	uint64_t event;
+	uint64_t delta;
+	uint16_t i;
+
+	sim_sync();
+
+	for( i = 0; i < NUM_TIMERS; i++ )
+	{
+		event = timer_next( &timers[i] );
+
+		if( event != SIM_NEVER && sim_cycles + event < next ) { next = sim_cycles + event; }
+	}
+
+	event = uart_next();
+	if( event < next ) { next = event; }
+
+	event = sim_pi_next_event();
+	if( event < next ) { next = event; }
+
+	if( next == SIM_NEVER )
+	{
+		sim_fail( "nothing left to wake the firmware" );
+	}
+
+	if( next < sim_cycles ) { next = sim_cycles; }
+	delta = next - sim_cycles;
+
+	for( i = 0; i < NUM_TIMERS; i++ )
+	{
+		timer_run( &timers[i], delta );
+	}
+
+	sim_cycles = next;
+
+	uart_run();
+	sim_pi_run();
+	sim_io_sample();
+	sim_vcd_flush();
+
+	sim_check_done();
+
+	return;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*sim_core_reset
+* Starts virtual time over with the peripherals idle
+* INPUT: None
+* RETURN: None
+*/
+void sim_core_reset( void )
+{
+	uint16_t i;
+
+	sim_cycles = 0;
+	gie        = FALSE;
+	in_isr     = FALSE;
+	woken      = FALSE;
+
+	for( i = 0; i < NUM_TIMERS; i++ )
+	{
+		timers[i].sub  = 0;
+		timers[i].out1 = 0;
+	}
+
+	rx_head      = 0;
+	rx_tail      = 0;
+	rx_line_free = 0;
+	tx_shifting  = FALSE;
+
+	return;
+}
+//============================================================================
+
+
+
+/*sim_idle
+* HAL_IDLE() - runs any pending interrupts, or else waits for the next
+*   hardware event
+* INPUT: None
+* RETURN: None
+*/
+void sim_idle( void )
+{
+	if( dispatch() == TRUE )
+	{
+		return;
+	}
+
+	advance( SIM_NEVER );
+	dispatch();
+
+	return;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+void __enable_interrupt( void )
+{
+	gie = TRUE;
+	dispatch();
+
+	return;
+}
+//============================================================================
+
+
+
+void __disable_interrupt( void )
+{
+	gie = FALSE;
+
+	return;
+}
+//============================================================================
+
+
+
+unsigned short __get_interrupt_state( void )
+{
+	return ( gie == TRUE ) ? GIE : 0;
+}
+//============================================================================
+
+
+
+void __set_interrupt_state( unsigned short state )
+{
+	gie = ( state & GIE ) ? TRUE : FALSE;
+	dispatch();
+
+	return;
+}
+//============================================================================
+
+
+
+/*__bis_SR_register
+* Sets GIE, and sleeps while CPUOFF is set - until an interrupt clears it on
+*   exit (the other low power bits only stop clocks nothing here needs)
+*/
+void __bis_SR_register( unsigned short bits )
+{
+	if( bits & GIE )
+	{
+		gie = TRUE;
+	}
+
+	if( bits & CPUOFF )
+	{
+		if( gie == FALSE )
+		{
+			sim_fail( "slept with interrupts disabled" );
+		}
+
+		woken = FALSE;
+		dispatch();
+
+		while( woken == FALSE )
+		{
+			advance( SIM_NEVER );
+			dispatch();
+		}
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+void __bic_SR_register( unsigned short bits )
+{
+	if( bits & GIE )
+	{
+		gie = FALSE;
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+void __bis_SR_register_on_exit( unsigned short bits )
+{
+	(void)bits;		// Staying asleep after the interrupt is the simulation's default
+
+	return;
+}
+//============================================================================
+
+
+
+void __bic_SR_register_on_exit( unsigned short bits )
+{
+	if( bits & CPUOFF )
+	{
+		woken = TRUE;
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+void __delay_cycles( unsigned long cycles )
+{
+	uint64_t end = sim_cycles + cycles;
+
+	while( sim_cycles < end )
+	{
+		advance( end );
+		dispatch();
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+void __no_operation( void )
+{
+	return;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // SIM
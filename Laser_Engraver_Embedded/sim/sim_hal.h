@@ -0,0 +1,39 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : sim_hal.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Hardware abstraction for the host simulation (included by
+//				 hal.h when built with SIM). The device header is used as is,
+//				 its registers are plain variables (sim_regs.c) that the
+//				 simulation core reads and updates in virtual time
+//============================================================================
+
+
+#ifndef SIM_HAL_H_
+#define SIM_HAL_H_
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "msp430f5529.h"		// Intrinsics come from sim/in430.h
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+void sim_idle( void );
+uint8_t * sim_flash( uint32_t addr );
+
+// See hal.h
+#define HAL_IDLE()				sim_idle()
+#define HAL_FLASH_PTR( addr )	sim_flash( addr )
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // SIM_HAL_H_
@@ -0,0 +1,202 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : sim_io.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : GPIO side of the host simulation - the step / direction
+//				 pins move a model of the head, which works the home switches
+//				 (and their port 2 interrupt flags). The lid stays closed.
+//				 Every pin of interest goes to the waveform file
+//============================================================================
+
+
+#ifdef SIM
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "hal.h"
+#include "defs.h"
+#include "sim.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Pins (see motors.c)
+#define X_STEP_PIN			BIT5		// P7
+#define X_DIR_PIN			BIT7		// P7, high = negative
+#define Y_STEP_PIN			BIT6		// P3
+#define Y_DIR_PIN			BIT0		// P4, high = negative
+#define DRV_RESET_PIN		BIT6		// P4, low = drivers held in reset
+#define DRV_ENABLE_PIN		BIT6		// P7, high = drivers disabled
+#define X_HOME_PIN			BIT0		// P2, low at home
+#define Y_HOME_PIN			BIT1		// P2, low at home
+
+
+static int32_t head_x;				// Head position (ticks from the home switches)
+static int32_t head_y;
+static uint32_t lost_steps;			// Step pulses given while the drivers were off
+
+// Outputs as last sampled
+static uint8_t last_p3;
+static uint8_t last_p7;
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*update_switches
+* Drives the home switch inputs from the head position, flagging the edge
+*   their interrupts are set to trigger on
+* INPUT: None
+* RETURN: None
+*/
+static void update_switches( void )
+{
+	uint8_t old_in = P2IN;
+	uint8_t new_in = old_in | X_HOME_PIN | Y_HOME_PIN;
+	uint8_t falling;
+	uint8_t rising;
+
+	if( head_x <= 0 ) { new_in &= ~X_HOME_PIN; }
+	if( head_y <= 0 ) { new_in &= ~Y_HOME_PIN; }
+
+	falling = old_in & ~new_in;
+	rising  = ~old_in & new_in;
+
+	P2IFG |= ( falling & P2IES ) | ( rising & ~P2IES );
+	P2IN   = new_in;
+
+	return;
+}
+//============================================================================
+
+
+
+/*record_pins
+* Gives the waveform file the outputs' (and home switches') levels now. The
+*   laser's PWM pin is TA0.1 while it is selected for the timer
+* INPUT: None
+* RETURN: None
+*/
+static void record_pins( void )
+{
+	uint8_t pwm = ( P1SEL & LASER_CTL_PIN ) ? sim_ta0_out1() : ( P1OUT & LASER_CTL_PIN );
+
+	sim_vcd_set( VCD_X_STEP,       P7OUT & X_STEP_PIN,     sim_cycles );
+	sim_vcd_set( VCD_X_DIR,        P7OUT & X_DIR_PIN,      sim_cycles );
+	sim_vcd_set( VCD_Y_STEP,       P3OUT & Y_STEP_PIN,     sim_cycles );
+	sim_vcd_set( VCD_Y_DIR,        P4OUT & Y_DIR_PIN,      sim_cycles );
+	sim_vcd_set( VCD_DRV_RESET,    P4OUT & DRV_RESET_PIN,  sim_cycles );
+	sim_vcd_set( VCD_DRV_ENABLE,   P7OUT & DRV_ENABLE_PIN, sim_cycles );
+	sim_vcd_set( VCD_X_HOME,       P2IN  & X_HOME_PIN,     sim_cycles );
+	sim_vcd_set( VCD_Y_HOME,       P2IN  & Y_HOME_PIN,     sim_cycles );
+	sim_vcd_set( VCD_LASER_PWM,    pwm,                    sim_cycles );
+	sim_vcd_set( VCD_LASER_ENABLE, P1OUT & LASER_ENA_PIN,  sim_cycles );
+	sim_vcd_set( VCD_FAN_ENABLE,   P7OUT & FAN_ENA_PIN,    sim_cycles );
+
+	return;
+}
+//============================================================================
+
+
+
+/*sim_io_reset
+* Puts the head at a position, with every input pulled high and the lid shut
+* INPUT: Head position (ticks from the home switches)
+* RETURN: None
+*/
+void sim_io_reset( int32_t x, int32_t y )
+{
+	head_x     = x;
+	head_y     = y;
+	lost_steps = 0;
+
+	P1IN = 0xFF;
+	P2IN = 0xFF;
+	P3IN = 0xFF;
+	P4IN = 0xFF;
+	P5IN = 0xFF;
+	P6IN = 0xFF;					// LID_OPEN reads high - closed
+	P7IN = 0xFF;
+	P8IN = 0xFF;
+
+	last_p3 = P3OUT;
+	last_p7 = P7OUT;
+
+	update_switches();
+	record_pins();
+
+	// Both UART lines idle high
+	sim_vcd_set( VCD_UART_TX, 1, sim_cycles );
+	sim_vcd_set( VCD_UART_RX, 1, sim_cycles );
+
+	return;
+}
+//============================================================================
+
+
+
+/*sim_io_sample
+* Looks at the outputs for step pulses (rising edges), moving the head in
+*   the direction set when the edge came
+* INPUT: None
+* RETURN: None
+*/
+void sim_io_sample( void )
+{
+	uint8_t p3 = P3OUT;
+	uint8_t p7 = P7OUT;
+	uint8_t enabled = ( ( P4OUT & DRV_RESET_PIN ) && !( P7OUT & DRV_ENABLE_PIN ) ) ? TRUE : FALSE;
+
+	if( ( p7 & ~last_p7 ) & X_STEP_PIN )
+	{
+		if( enabled == FALSE )          { lost_steps++; }
+		else if( P7OUT & X_DIR_PIN )    { head_x--; }
+		else                            { head_x++; }
+	}
+
+	if( ( p3 & ~last_p3 ) & Y_STEP_PIN )
+	{
+		if( enabled == FALSE )          { lost_steps++; }
+		else if( P4OUT & Y_DIR_PIN )    { head_y--; }
+		else                            { head_y++; }
+	}
+
+	last_p3 = p3;
+	last_p7 = p7;
+
+	update_switches();
+	record_pins();
+
+	return;
+}
+//============================================================================
+
+
+
+void sim_io_position( int32_t * x, int32_t * y )
+{
+	*x = head_x;
+	*y = head_y;
+
+	return;
+}
+//============================================================================
+
+
+
+uint32_t sim_io_lost_steps( void )
+{
+	return lost_steps;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // SIM
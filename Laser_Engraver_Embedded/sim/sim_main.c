@@ -0,0 +1,200 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : sim_main.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Entry point of the host simulation. Runs the firmware's
+//				 main (built as firmware_main) against the simulated board
+//				 and Pi until the picture has been burned, then reports the
+//				 job time and the statistics (and optionally writes the pins'
+//				 waveforms)
+//============================================================================
+
+
+#ifdef SIM
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "hal.h"
+#include "defs.h"
+#include "stats.h"
+#include "laser_driver.h"
+#include "sim.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+int firmware_main( void );
+
+// Firmware state the run is followed by
+extern volatile uint8_t picture_ip;
+extern volatile uint8_t home_pending;
+extern volatile uint32_t xPos;
+extern volatile uint32_t yPos;
+extern uint32_t burns_done;
+
+extern uint32_t sim_uart_overruns;
+
+static const char * const stat_names[STATS_COUNT] =
+{
+	"rx packets", "rx errors", "rx overruns", "rx resyncs", "tx overruns",
+	"naks sent", "naks received", "resends", "ready resends", "retx failures",
+	"pixel timeouts", "halts", "burns", "comm wait ms", "motion ms", "burn ms"
+};
+
+static uint64_t limit_cycles;		// Give up on the picture at this cycle
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+static void usage( void )
+{
+	fprintf( stderr,
+			 "usage: laser_sim [-p payloads] [-s WxH] [-l latency_us] [-t limit_s] [-x px] [-y px] [-v file.vcd]\n"
+			 "  -p  burn commands to send, one payload per line (default a test pattern)\n"
+			 "  -s  size of the test pattern (default 32x16)\n"
+			 "  -l  time the Pi takes to answer each message (default 2000 us)\n"
+			 "  -t  virtual time to give up after (default 3600 s)\n"
+			 "  -x  -y  head position at power-up (default 50, 50 px from home)\n"
+			 "  -v  write the step / direction, laser and UART pins to a VCD file\n" );
+	exit( 2 );
+}
+//============================================================================
+
+
+
+/*report
+* Prints how the run went and ends the simulation
+* INPUT: TRUE if the picture finished, FALSE if the time limit ran out
+* RETURN: Never returns
+*/
+static void report( uint8_t finished )
+{
+	int32_t x;
+	int32_t y;
+	uint8_t i;
+
+	sim_vcd_close();
+
+	sim_io_position( &x, &y );
+
+	printf( "%s after %.3f s virtual\n", ( finished == TRUE ) ? "Picture done" : "Time limit reached",
+			(double)sim_cycles / SMCLK_HZ );
+	printf( "  job time        %.3f s (from CMD_START)\n",
+			(double)( sim_cycles - sim_pi_start_cycles() ) / SMCLK_HZ );
+	printf( "  burn commands   %lu sent, %lu burned\n",
+			(unsigned long)sim_pi_sent(), (unsigned long)burns_done );
+	printf( "  head            %ld, %ld ticks (firmware has %lu, %lu), %lu steps lost\n",
+			(long)x, (long)y, (unsigned long)xPos, (unsigned long)yPos, (unsigned long)sim_io_lost_steps() );
+	printf( "  uart overruns   %lu\n", (unsigned long)sim_uart_overruns );
+
+	for( i = 0; i < STATS_COUNT; i++ )
+	{
+		printf( "  %-15s %lu\n", stat_names[i], (unsigned long)stats_get( i ) );
+	}
+
+	exit( ( finished == TRUE ) ? 0 : 1 );
+}
+//============================================================================
+
+
+
+/*sim_check_done
+* Called whenever virtual time has moved on. The picture is done once the Pi
+*   has had CMD_END acknowledged and the MSP has finished every burn (and the
+*   homing it does after)
+* INPUT: None
+* RETURN: None (doesn't return once done)
+*/
+void sim_check_done( void )
+{
+	if( sim_pi_done() == TRUE && picture_ip == FALSE && home_pending == FALSE && burn_busy() == FALSE )
+	{
+		report( TRUE );
+	}
+
+	if( sim_cycles >= limit_cycles )
+	{
+		report( FALSE );
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+int main( int argc, char * argv[] )
+{
+	unsigned int width  = 32;
+	unsigned int height = 16;
+	uint32_t latency_us = 2000;
+	uint32_t limit_s    = 3600;
+	int32_t  start_x    = 50;
+	int32_t  start_y    = 50;
+	const char * path   = 0;
+	const char * vcd    = 0;
+	int opt;
+
+	while( ( opt = getopt( argc, argv, "p:s:l:t:x:y:v:" ) ) != -1 )
+	{
+		switch( opt )
+		{
+			case 'p': path = optarg;									break;
+			case 's': if( sscanf( optarg, "%ux%u", &width, &height ) != 2 ) { usage(); }	break;
+			case 'l': latency_us = strtoul( optarg, 0, 0 );				break;
+			case 't': limit_s    = strtoul( optarg, 0, 0 );				break;
+			case 'x': start_x    = strtol( optarg, 0, 0 );				break;
+			case 'y': start_y    = strtol( optarg, 0, 0 );				break;
+			case 'v': vcd        = optarg;								break;
+			default:  usage();
+		}
+	}
+
+	if( path != 0 )
+	{
+		if( sim_pi_load( path ) == FALSE )
+		{
+			fprintf( stderr, "laser_sim: can't read %s\n", path );
+			return 2;
+		}
+	}
+	else
+	{
+		sim_pi_pattern( width, height );
+	}
+
+	if( vcd != 0 && sim_vcd_open( vcd ) == FALSE )
+	{
+		fprintf( stderr, "laser_sim: can't write %s\n", vcd );
+		return 2;
+	}
+
+	limit_cycles = (uint64_t)limit_s * SMCLK_HZ;
+
+	sim_core_reset();
+	sim_regs_reset();
+	sim_io_reset( start_x * TCK2PXL, start_y * TCK2PXL );
+	sim_pi_reset( latency_us );
+
+	// Never returns - the run ends in sim_check_done()
+	firmware_main();
+
+	sim_fail( "firmware main returned" );
+	return 2;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // SIM
@@ -0,0 +1,437 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : sim_pi.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : The Pi's side of the link for the host simulation. Runs a
+//				 picture the way rpSerial.py does - CMD_INIT, CMD_START, then
+//				 each burn command once the MSP asks for the next pixel, and
+//				 CMD_END - answering every message after a fixed latency
+//============================================================================
+
+
+#ifdef SIM
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hal.h"
+#include "defs.h"
+#include "sim.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Waiting on the MSP to ...
+#define PI_INIT			0			// ... acknowledge CMD_INIT
+#define PI_START		1			// ... acknowledge CMD_START (it waits on the lid first)
+#define PI_BURN			2			// ... acknowledge the burn command and ask for the next
+#define PI_END			3			// ... acknowledge CMD_END
+#define PI_DONE			4
+
+// A command the MSP hasn't answered is sent again after this long (as
+//   receiveX gives up on the line)
+#define PI_TIMEOUT_US	1000000
+
+#define PI_LEVELS		4			// Laser levels a burn command can give (bits 27-28)
+
+static uint32_t * payloads = 0;		// Burn commands of the picture
+static uint32_t num_payloads = 0;
+static uint32_t next_payload;
+
+static uint8_t  state;
+static uint8_t  burn_acked;			// Burn command in flight has been acknowledged
+static uint8_t  burn_ready;			// MSP has asked for the next pixel
+static uint32_t latency_us;			// Time the Pi takes to answer
+static uint64_t timeout;			// Cycle to send the last command again
+static uint64_t start_cycles;		// CMD_START was sent
+
+// Last command sent, for resending
+static uint8_t  last_frame[MAX_PACKET_LENGTH];
+static uint16_t last_length;
+
+// Frame coming in from the MSP
+static uint8_t  rx_frame[MAX_PACKET_LENGTH];
+static uint16_t rx_length;
+static uint8_t  rx_in_frame;
+static uint8_t  rx_escape;
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*sim_pi_load
+* Reads the picture's burn commands, one payload per line (as the Pi would
+*   send them, e.g. 0x10014006). Blank lines and lines starting with # are
+*   skipped
+* INPUT: File
+* RETURN: TRUE if read, FALSE else
+*/
+uint8_t sim_pi_load( const char * path )
+{
+	FILE * f = fopen( path, "r" );
+	char line[128];
+	uint32_t size = 0;
+
+	if( f == 0 )
+	{
+		return FALSE;
+	}
+
+	num_payloads = 0;
+
+	while( fgets( line, sizeof( line ), f ) != 0 )
+	{
+		if( line[0] == '#' || line[0] == '\n' || line[0] == '\r' )
+		{
+			continue;
+		}
+
+		if( num_payloads == size )
+		{
+			size = ( size == 0 ) ? 1024 : size * 2;
+			payloads = realloc( payloads, size * sizeof( uint32_t ) );
+
+			if( payloads == 0 ) { sim_fail( "out of memory for the picture" ); }
+		}
+
+		payloads[num_payloads++] = (uint32_t)strtoul( line, 0, 0 );
+	}
+
+	fclose( f );
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*sim_pi_pattern
+* Makes up a test picture - every pixel of the area, rows in a serpentine,
+*   with the level stepping up across each row
+* INPUT: Width and height (pixels)
+* RETURN: None
+*/
+void sim_pi_pattern( uint16_t width, uint16_t height )
+{
+	uint32_t x;
+	uint32_t y;
+	uint32_t i;
+	uint32_t level;
+
+	num_payloads = (uint32_t)width * height;
+	payloads = realloc( payloads, num_payloads * sizeof( uint32_t ) );
+
+	if( payloads == 0 && num_payloads > 0 ) { sim_fail( "out of memory for the picture" ); }
+
+	for( y = 0; y < height; y++ )
+	{
+		for( i = 0; i < width; i++ )
+		{
+			x = ( y & 1 ) ? width - 1 - i : i;
+			level = ( x * PI_LEVELS ) / width;
+
+			payloads[y * width + i] = ( level << 27 ) | ( x << 14 ) | ( y << 1 );
+		}
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*send_frame
+* Packs a command as pack_tx_packet() does and puts it on the line after the
+*   Pi's latency
+* INPUT: Command, ack byte (NEW_CMD for a command), payload (LSB first) and size
+* RETURN: None
+*/
+static void send_frame( uint8_t command, uint8_t ack, const uint8_t * data, uint8_t size )
+{
+	uint8_t frame[MAX_PACKET_LENGTH];
+	uint16_t length = 0;
+	uint8_t checksum = 0;
+	int16_t i;
+
+	frame[length++] = STX;
+
+	if( ack != NEW_CMD )
+	{
+		frame[length++] = ack;
+	}
+
+	frame[length++] = command;
+
+	if( size > 0 )
+	{
+		for( i = size - 1; i >= 0; i-- )
+		{
+			if( data[i] == STX || data[i] == ETX || data[i] == ESC ) { frame[length++] = ESC; }
+
+			frame[length++] = data[i];
+			checksum += data[i];
+		}
+
+		checksum = 256 - checksum;
+
+		if( checksum == STX || checksum == ETX || checksum == ESC ) { frame[length++] = ESC; }
+
+		frame[length++] = checksum;
+	}
+
+	frame[length++] = ETX;
+
+	sim_uart_send( frame, length, latency_us );
+
+	// Commands are sent again if they go unanswered (acks are not)
+	if( ack == NEW_CMD )
+	{
+		for( i = 0; i < length; i++ ) { last_frame[i] = frame[i]; }
+		last_length = length;
+
+		timeout = sim_cycles + SIM_US_TO_CYCLES( latency_us + PI_TIMEOUT_US );
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+static void resend( void )
+{
+	sim_uart_send( last_frame, last_length, latency_us );
+	timeout = sim_cycles + SIM_US_TO_CYCLES( latency_us + PI_TIMEOUT_US );
+
+	return;
+}
+//============================================================================
+
+
+
+/*send_next
+* Sends the next burn command, or CMD_END once they have all gone
+* INPUT: None
+* RETURN: None
+*/
+static void send_next( void )
+{
+	uint8_t data[CMD_BURN_PAYLOAD_SIZE];
+	uint32_t payload;
+
+	if( next_payload < num_payloads )
+	{
+		payload = payloads[next_payload++];
+
+		data[0] = payload & 0xFF;
+		data[1] = ( payload >> 8 )  & 0xFF;
+		data[2] = ( payload >> 16 ) & 0xFF;
+		data[3] = ( payload >> 24 ) & 0xFF;
+
+		burn_acked = FALSE;
+		burn_ready = FALSE;
+		send_frame( CMD_BURN, NEW_CMD, data, CMD_BURN_PAYLOAD_SIZE );
+		state = PI_BURN;
+	}
+	else
+	{
+		send_frame( CMD_END, NEW_CMD, 0, 0 );
+		state = PI_END;
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*handle_frame
+* Acts on a frame from the MSP (STX, ETX and escapes removed)
+* INPUT: None
+* RETURN: None
+*/
+static void handle_frame( void )
+{
+	uint8_t ack;
+	uint8_t command;
+
+	if( rx_length == 0 )
+	{
+		return;
+	}
+
+	if( rx_frame[0] == ACK_MSG || rx_frame[0] == NAK_MSG )
+	{
+		ack     = rx_frame[0];
+		command = ( rx_length > 1 ) ? rx_frame[1] : NAK_MSG;
+
+		if( ack == NAK_MSG )
+		{
+			// The MSP couldn't take it (or it was garbled) - send it again
+			if( state != PI_DONE ) { resend(); }
+			return;
+		}
+
+		if( state == PI_INIT && command == CMD_INIT )
+		{
+			send_frame( CMD_START, NEW_CMD, 0, 0 );
+			start_cycles = sim_cycles;
+			state = PI_START;
+		}
+		else if( state == PI_START && command == CMD_START )
+		{
+			send_next();
+		}
+		else if( state == PI_BURN && command == CMD_BURN )
+		{
+			burn_acked = TRUE;
+			timeout = SIM_NEVER;
+
+			if( burn_ready == TRUE ) { send_next(); }
+		}
+		else if( state == PI_END && command == CMD_END )
+		{
+			timeout = SIM_NEVER;
+			state = PI_DONE;
+		}
+
+		return;
+	}
+
+	// A message from the MSP - acknowledge it
+	command = rx_frame[0];
+
+	if( command == CMD_PIXEL_READY || command == CMD_INIT || command == CMD_PROGRESS || command == CMD_EMERGENCY )
+	{
+		send_frame( command, ACK_MSG, 0, 0 );
+	}
+
+	if( command == CMD_PIXEL_READY && state == PI_BURN )
+	{
+		burn_ready = TRUE;
+
+		if( burn_acked == TRUE ) { send_next(); }
+	}
+
+	return;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*sim_pi_reset
+* Starts the picture over, sending CMD_INIT first
+* INPUT: Time the Pi takes to answer a message (us)
+* RETURN: None
+*/
+void sim_pi_reset( uint32_t latency )
+{
+	latency_us   = latency;
+	next_payload = 0;
+	rx_length    = 0;
+	rx_in_frame  = FALSE;
+	rx_escape    = FALSE;
+	start_cycles = 0;
+
+	send_frame( CMD_INIT, NEW_CMD, 0, 0 );
+	state = PI_INIT;
+
+	return;
+}
+//============================================================================
+
+
+
+/*sim_pi_receive
+* Takes a char sent by the MSP, acting on each frame once its ETX arrives
+* INPUT: Char
+* RETURN: None
+*/
+void sim_pi_receive( uint8_t c )
+{
+	if( rx_escape == FALSE && c == STX )
+	{
+		rx_in_frame = TRUE;
+		rx_length   = 0;
+	}
+	else if( rx_in_frame == FALSE )
+	{
+		return;
+	}
+	else if( rx_escape == FALSE && c == ESC )
+	{
+		rx_escape = TRUE;
+	}
+	else if( rx_escape == FALSE && c == ETX )
+	{
+		rx_in_frame = FALSE;
+		handle_frame();
+	}
+	else
+	{
+		rx_escape = FALSE;
+
+		if( rx_length < MAX_PACKET_LENGTH ) { rx_frame[rx_length++] = c; }
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+uint64_t sim_pi_next_event( void )
+{
+	return ( state == PI_DONE ) ? SIM_NEVER : timeout;
+}
+//============================================================================
+
+
+
+void sim_pi_run( void )
+{
+	if( state != PI_DONE && sim_cycles >= timeout )
+	{
+		resend();
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+uint8_t sim_pi_done( void )
+{
+	return ( state == PI_DONE ) ? TRUE : FALSE;
+}
+//============================================================================
+
+
+
+uint64_t sim_pi_start_cycles( void )
+{
+	return start_cycles;
+}
+//============================================================================
+
+
+
+uint32_t sim_pi_sent( void )
+{
+	return next_payload;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // SIM
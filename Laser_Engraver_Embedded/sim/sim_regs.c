@@ -0,0 +1,110 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : sim_regs.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Memory map of the host simulation - every register of the
+//				 device header as a plain variable (the linker command file
+//				 places them on the MSP430), and the job flash
+//============================================================================
+
+
+#ifdef SIM
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+#include <string.h>
+
+// Define the registers here rather than declaring them (see msp430f5529.h).
+//   The 8-bit halves of a 16-bit register are separate variables, which is
+//   fine as long as the firmware sticks to one name for each register
+typedef void ( * __SFR_FARPTR )();
+#define SFR_8BIT( address )		volatile unsigned char address
+#define SFR_16BIT( address )	volatile unsigned int address
+#define SFR_20BIT( address )	__SFR_FARPTR address
+#define SFR_32BIT( address )	volatile unsigned long address
+
+#include "hal.h"
+#include "defs.h"
+#include "sim.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Job flash (JOB_FLASH_START to JOB_FLASH_START + JOB_FLASH_SIZE), aligned for
+//   the header and word reads
+static uint16_t flash[JOB_FLASH_SIZE / 2];
+
+// Target of the dummy write that starts an erase
+static uint16_t erase_scratch;
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*sim_regs_reset
+* Puts the registers the firmware waits on in their power-up state, and erases
+*   the job flash
+* INPUT: None
+* RETURN: None
+*/
+void sim_regs_reset( void )
+{
+	// Supervisors settle (and VCORE is reached) at once
+	PMMIFG = SVSMLDLYIFG | SVMLVLRIFG;
+
+	// Transmit buffer empty
+	UCA1IFG = UCTXIFG;
+
+	memset( flash, 0xFF, sizeof( flash ) );
+
+	return;
+}
+//============================================================================
+
+
+
+/*sim_flash
+* Maps an address of the job flash to the simulated flash. A bank erase is
+*   started by a dummy write through this pointer, so when an erase is enabled
+*   the bank is erased here and the write goes to a scratch word. Writes are
+*   done at once (BUSY never reads set)
+* INPUT: Flash address
+* RETURN: Pointer to the byte
+*/
+uint8_t * sim_flash( uint32_t addr )
+{
+	uint32_t offset;
+	uint32_t bank;
+	uint32_t bank_size;
+
+	if( addr < JOB_FLASH_START || addr >= JOB_FLASH_START + JOB_FLASH_SIZE )
+	{
+		sim_fail( "flash access outside the job area" );
+	}
+
+	offset = addr - JOB_FLASH_START;
+
+	if( FCTL1 & ( MERAS | ERASE ) )
+	{
+		// The job area starts on a bank boundary (banks C and D)
+		bank      = offset - ( offset % JOB_FLASH_BANK_SIZE );
+		bank_size = ( bank + JOB_FLASH_BANK_SIZE > JOB_FLASH_SIZE ) ? JOB_FLASH_SIZE - bank : JOB_FLASH_BANK_SIZE;
+
+		memset( (uint8_t *)flash + bank, 0xFF, bank_size );
+
+		return (uint8_t *)&erase_scratch;
+	}
+
+	return (uint8_t *)flash + offset;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // SIM
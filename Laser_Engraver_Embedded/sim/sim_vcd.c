@@ -0,0 +1,350 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : sim_vcd.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-29 (Created), 2015-04-29 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Waveform output of the host simulation - the step / direction,
+//				 driver, laser and UART pins written as a VCD file (for
+//				 GTKWave) with the SMCLK cycle each one changed at
+//============================================================================
+
+
+#ifdef SIM
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hal.h"
+#include "defs.h"
+#include "sim.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#define VCD_UNKNOWN		2			// Value before the first change (x)
+
+struct TVcd_Signal
+{
+	const char * scope;
+	const char * name;
+	uint8_t pushed;					// Value of the last change queued
+};
+
+// In VCD_* order, each scope's signals together
+static struct TVcd_Signal signals[VCD_NUM_SIGNALS] =
+{
+	{ "motors", "x_step",         VCD_UNKNOWN },	// P7.5
+	{ "motors", "x_dir",          VCD_UNKNOWN },	// P7.7, high = negative
+	{ "motors", "y_step",         VCD_UNKNOWN },	// P3.6
+	{ "motors", "y_dir",          VCD_UNKNOWN },	// P4.0, high = negative
+	{ "motors", "drv_reset_n",    VCD_UNKNOWN },	// P4.6
+	{ "motors", "drv_enable_n",   VCD_UNKNOWN },	// P7.6
+	{ "motors", "x_home_n",       VCD_UNKNOWN },	// P2.0
+	{ "motors", "y_home_n",       VCD_UNKNOWN },	// P2.1
+	{ "laser",  "laser_pwm",      VCD_UNKNOWN },	// P1.2 (TA0.1)
+	{ "laser",  "laser_enable",   VCD_UNKNOWN },	// P1.3
+	{ "laser",  "fan_enable",     VCD_UNKNOWN },	// P7.0
+	{ "uart",   "tx",             VCD_UNKNOWN },	// P4.4, MSP to Pi
+	{ "uart",   "rx",             VCD_UNKNOWN },	// P4.5, Pi to MSP
+};
+
+
+// Changes are queued (a heap on time, then order queued) and written once
+//   virtual time has passed them - a char's UART bits are queued when it
+//   starts, ahead of the pin changes that come while it is on the line
+struct TVcd_Change
+{
+	uint64_t at;					// SMCLK cycle
+	uint32_t seq;
+	uint8_t  signal;
+	uint8_t  value;
+};
+
+static struct TVcd_Change * changes = 0;
+static uint32_t num_changes = 0;
+static uint32_t size_changes = 0;
+static uint32_t next_seq = 0;
+
+static FILE * vcd = 0;
+static uint64_t last_ns;			// Time of the last #time line written
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+static uint8_t change_before( const struct TVcd_Change * a, const struct TVcd_Change * b )
+{
+	return ( a->at < b->at || ( a->at == b->at && a->seq < b->seq ) ) ? TRUE : FALSE;
+}
+//============================================================================
+
+
+
+static void heap_push( struct TVcd_Change * change )
+{
+	uint32_t i;
+	uint32_t parent;
+	uint32_t size;
+	struct TVcd_Change * grown;
+
+	if( num_changes == size_changes )
+	{
+		// Keep the old heap if this fails, so sim_fail() can still write it out
+		size  = ( size_changes == 0 ) ? 1024 : size_changes * 2;
+		grown = realloc( changes, size * sizeof( struct TVcd_Change ) );
+
+		if( grown == 0 )
+		{
+			sim_fail( "out of memory for the waveform" );
+		}
+
+		changes      = grown;
+		size_changes = size;
+	}
+
+	for( i = num_changes++; i > 0; i = parent )
+	{
+		parent = ( i - 1 ) / 2;
+
+		if( change_before( change, &changes[parent] ) == FALSE ) { break; }
+
+		changes[i] = changes[parent];
+	}
+
+	changes[i] = *change;
+
+	return;
+}
+//============================================================================
+
+
+
+static void heap_pop( void )
+{
+	struct TVcd_Change last = changes[--num_changes];
+	uint32_t i = 0;
+	uint32_t child;
+
+	while( ( child = 2 * i + 1 ) < num_changes )
+	{
+		if( child + 1 < num_changes && change_before( &changes[child + 1], &changes[child] ) == TRUE ) { child++; }
+
+		if( change_before( &changes[child], &last ) == FALSE ) { break; }
+
+		changes[i] = changes[child];
+		i = child;
+	}
+
+	changes[i] = last;
+
+	return;
+}
+//============================================================================
+
+
+
+/*cycles_to_ns
+* INPUT: SMCLK cycle
+* RETURN: Time in ns (the file's timescale), split so it can't overflow
+*/
+static uint64_t cycles_to_ns( uint64_t cycles )
+{
+	return ( cycles / SMCLK_HZ ) * 1000000000ULL + ( cycles % SMCLK_HZ ) * 1000000000ULL / SMCLK_HZ;
+}
+//============================================================================
+
+
+
+static void write_change( const struct TVcd_Change * change )
+{
+	uint64_t ns = cycles_to_ns( change->at );
+
+	if( ns != last_ns )
+	{
+		fprintf( vcd, "#%llu\n", (unsigned long long)ns );
+		last_ns = ns;
+	}
+
+	fprintf( vcd, "%c%c\n", '0' + change->value, '!' + change->signal );
+
+	return;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*sim_vcd_open
+* Starts the waveform file, with every signal unknown until the simulation
+*   first sets it
+* INPUT: File
+* RETURN: TRUE if opened, FALSE else
+*/
+uint8_t sim_vcd_open( const char * path )
+{
+	const char * scope = 0;
+	uint8_t i;
+
+	vcd = fopen( path, "w" );
+
+	if( vcd == 0 )
+	{
+		return FALSE;
+	}
+
+	fprintf( vcd, "$version Laser Engraver Embedded simulation $end\n" );
+	fprintf( vcd, "$timescale 1ns $end\n" );
+
+	for( i = 0; i < VCD_NUM_SIGNALS; i++ )
+	{
+		if( scope != signals[i].scope )
+		{
+			if( scope != 0 ) { fprintf( vcd, "$upscope $end\n" ); }
+
+			scope = signals[i].scope;
+			fprintf( vcd, "$scope module %s $end\n", scope );
+		}
+
+		fprintf( vcd, "$var wire 1 %c %s $end\n", '!' + i, signals[i].name );
+	}
+
+	fprintf( vcd, "$upscope $end\n" );
+	fprintf( vcd, "$enddefinitions $end\n" );
+
+	fprintf( vcd, "#0\n$dumpvars\n" );
+
+	for( i = 0; i < VCD_NUM_SIGNALS; i++ )
+	{
+		fprintf( vcd, "x%c\n", '!' + i );
+		signals[i].pushed = VCD_UNKNOWN;
+	}
+
+	fprintf( vcd, "$end\n" );
+
+	last_ns = 0;
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*sim_vcd_set
+* Queues a signal's value from a cycle on (ignored if it already has it).
+*   Each signal's changes must be queued in time order, no earlier than the
+*   current cycle
+* INPUT: Signal (VCD_*), value (zero / non-zero) and SMCLK cycle
+* RETURN: None
+*/
+void sim_vcd_set( uint8_t signal, uint8_t value, uint64_t at )
+{
+	struct TVcd_Change change;
+
+	value = ( value != 0 ) ? 1 : 0;
+
+	if( vcd == 0 || signals[signal].pushed == value )
+	{
+		return;
+	}
+
+	signals[signal].pushed = value;
+
+	change.at     = at;
+	change.seq    = next_seq++;
+	change.signal = signal;
+	change.value  = value;
+
+	heap_push( &change );
+
+	return;
+}
+//============================================================================
+
+
+
+/*sim_vcd_uart
+* Queues the bits of a char on a UART line - start bit, 8 data bits LSB
+*   first and the stop bit, at the baud rate
+* INPUT: Signal (VCD_UART_*), char and SMCLK cycle its start bit begins
+* RETURN: None
+*/
+void sim_vcd_uart( uint8_t signal, uint8_t c, uint64_t start )
+{
+	uint8_t i;
+
+	sim_vcd_set( signal, 0, start );
+
+	for( i = 0; i < 8; i++ )
+	{
+		sim_vcd_set( signal, ( c >> i ) & 0x01, start + ( i + 1 ) * SIM_CHAR_CYCLES / 10 );
+	}
+
+	sim_vcd_set( signal, 1, start + 9 * SIM_CHAR_CYCLES / 10 );
+
+	return;
+}
+//============================================================================
+
+
+
+/*sim_vcd_flush
+* Writes the changes virtual time has reached
+* INPUT: None
+* RETURN: None
+*/
+void sim_vcd_flush( void )
+{
+	if( vcd == 0 )
+	{
+		return;
+	}
+
+	while( num_changes > 0 && changes[0].at <= sim_cycles )
+	{
+		write_change( &changes[0] );
+		heap_pop();
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*sim_vcd_close
+* Writes what has happened up to now and ends the file (changes queued for
+*   later - the rest of a char on the line - are left out)
+* INPUT: None
+* RETURN: None
+*/
+void sim_vcd_close( void )
+{
+	if( vcd == 0 )
+	{
+		return;
+	}
+
+	sim_vcd_flush();
+
+	if( cycles_to_ns( sim_cycles ) != last_ns )
+	{
+		fprintf( vcd, "#%llu\n", (unsigned long long)cycles_to_ns( sim_cycles ) );
+	}
+
+	fclose( vcd );
+	vcd = 0;
+
+	return;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // SIM
@@ -0,0 +1,118 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : stats.c
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-27 (Created), 2015-04-27 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Source code for the statistics counters. Link errors,
+//				 retries and halts are counted where they happen, and the
+//				 time of a picture is split between waiting on commands,
+//				 moving and burning, so a slow picture can be explained.
+//				 The Pi reads (and optionally resets) them with CMD_STATS.
+//============================================================================
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "defs.h"
+#include "stats.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+extern volatile uint32_t time_ms;
+
+// Counted by the UART (see uart_fifo.c)
+extern volatile uint16_t rx_overruns;
+extern volatile uint16_t rx_resyncs;
+extern volatile uint16_t tx_overruns;
+
+uint32_t stats[STATS_COUNT];
+
+// Phase the time since phase_start is being counted against
+static uint8_t  phase_now = STATS_PHASE_NONE;
+static uint32_t phase_start;
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+/*stats_phase
+* Adds the time since the last change of phase to the phase being left
+* INPUT: Phase from now on (STATS_PHASE_x)
+* RETURN: None
+*/
+void stats_phase( uint8_t phase )
+{
+	uint32_t now = time_ms;
+
+	if( phase_now != STATS_PHASE_NONE )
+	{
+		stats[ STAT_COMM_WAIT_MS + phase_now ] += now - phase_start;
+	}
+
+	phase_now   = phase;
+	phase_start = now;
+
+	return;
+}
+//============================================================================
+
+
+
+/*stats_get
+* Reads a counter. Phase times include the phase in progress
+* INPUT: Counter (STAT_x)
+* RETURN: Its value
+*/
+uint32_t stats_get( uint8_t id )
+{
+	switch( id )
+	{
+		case STAT_RX_OVERRUNS : return rx_overruns;
+		case STAT_RX_RESYNCS  : return rx_resyncs;
+		case STAT_TX_OVERRUNS : return tx_overruns;
+		default				  : break;
+	}
+
+	if( id >= STATS_COUNT )
+	{
+		return 0;
+	}
+
+	stats_phase( phase_now );
+
+	return stats[id];
+}
+//============================================================================
+
+
+
+/*stats_reset
+* Clears every counter, so the next read covers the time since
+* INPUT: None
+* RETURN: None
+*/
+void stats_reset( void )
+{
+	uint8_t i;
+
+	for( i = 0; i < STATS_COUNT; i++ )
+	{
+		stats[i] = 0;
+	}
+
+	rx_overruns = 0;
+	rx_resyncs  = 0;
+	tx_overruns = 0;
+
+	phase_start = time_ms;
+
+	return;
+}
+//============================================================================
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,40 @@
+//============================================================================
+// Project	   : Laser Engraver Embedded
+// Name        : stats.h
+// Author      : Garin Newcomb
+// Email       : gpnewcomb@live.com
+// Date		   : 2015-04-27 (Created), 2015-04-27 (Last Updated)
+// Copyright   : Copyright 2014-2015 University of Nebraska-Lincoln
+// Description : Header file including function prototypes and macros used for
+//				 the statistics counters (read by the Pi with CMD_STATS)
+//============================================================================
+
+
+#ifndef STATS_H_
+#define STATS_H_
+
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdint.h>
+
+#include "defs.h"
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Counters, indexed by STAT_x (main program only - the interrupts keep their own)
+extern uint32_t stats[STATS_COUNT];
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+void stats_phase( uint8_t phase );
+uint32_t stats_get( uint8_t id );
+void stats_reset( void );
+
+////////////////////////////////////////////////////////////////////////////////
+
+
+#endif // STATS_H_
@@ -14,15 +14,18 @@
 
 #include <stdint.h>
 
-#include "msp430f5529.h"
+#include "hal.h"
 #include "defs.h"
 #include "time.h"
+#include "laser_driver.h"
+#include "scheduler.h"
+#include "profile.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
 volatile uint32_t time_ms   = 0;
-volatile uint32_t time_10us = 0;
+volatile uint16_t tstamp_hi = 0;		// Upper half of the timestamp (Timer B0 overflows)
 volatile uint32_t count = 0;
 
 volatile int timer_flag = FALSE;
@@ -32,28 +35,84 @@ volatile int timer=0;
 ////////////////////////////////////////////////////////////////////////////////
 
 
-// Set SMCLK to ~12.3 MHz, which is used for most peripherals
+/*set_vcore_up
+* Raises the PMM core voltage by one level, waiting for the high- and low-side
+*   supervisors to settle (TI's SetVCoreUp sequence)
+* INPUT: Target core level (1-3), one above the present level
+* RETURN: None
+*/
+static void set_vcore_up( uint8_t level )
+{
+	PMMCTL0_H = PMMPW_H;					// Unlock the PMM registers
+
+	// Raise the high-side supervisor / monitor to the new level
+	SVSMHCTL  = SVSHE + SVSHRVL0 * level + SVMHE + SVSMHRRL0 * level;
+
+	// Set the low-side monitor to the new level, supervisor at the present level
+	SVSMLCTL  = SVSLE + SVMLE + SVSMLRRL0 * level;
+
+	while( ( PMMIFG & SVSMLDLYIFG ) == 0 );	// Wait for SVS-L to settle
+	PMMIFG   &= ~( SVMLVLRIFG + SVMLIFG );
+
+	PMMCTL0_L = PMMCOREV0 * level;			// Raise VCORE
+
+	// Wait until VCORE has reached the new level, if it was below it
+	if( PMMIFG & SVMLIFG )
+	{
+		while( ( PMMIFG & SVMLVLRIFG ) == 0 );
+	}
+
+	// Move the low-side supervisor up to the new level as well
+	SVSMLCTL  = SVSLE + SVSLRVL0 * level + SVMLE + SVSMLRRL0 * level;
+
+	PMMCTL0_H = 0x00;						// Lock the PMM registers
+
+	return;
+}
+//============================================================================
+
+
+
+// Set MCLK and SMCLK to 24.576 MHz (see SMCLK_HZ), which is used for most peripherals
 void init_clocks( void )
 {
-	// Setup DCO (will be used as source to SMCLK, which in turn will be used as source to BRCLK)
+	uint8_t level;
+
 	WDTCTL   = WDTPW+WDTHOLD;               // Stop WDT
+
+	// The core must be at the highest voltage level before MCLK goes above 20 MHz,
+	//   and it can only be raised one level at a time
+	for( level = 1; level <= PMM_CORE_LEVEL; level++ )
+	{
+		set_vcore_up( level );
+	}
+
+	// Setup DCO (will be used as source to SMCLK, which in turn will be used as source to BRCLK)
 	UCSCTL3 |= SELREF_2;                    // Set DCO FLL reference = REFO
 	UCSCTL4 |= SELA_2;                      // Set ACLK = REFO
 
 	__bis_SR_register(SCG0);                // Disable the FLL control loop
 
 	UCSCTL0  = 0x0000;                      // Set lowest possible DCOx, MODx
-	UCSCTL1  = DCORSEL_5;                   // Select DCO range 24MHz operation
-	UCSCTL2  = FLLD_1 + 374;                // Set DCO Multiplier for 12MHz
+	UCSCTL1  = DCORSEL_7;                   // Select DCO range 50MHz operation
+	UCSCTL2  = FLLD_0 + DCO_FLLN;           // Set DCO Multiplier for 24.576MHz
 											// (N + 1) * FLLRef = Fdco
-											// (374 + 1) * 32768 = 12.28MHz
-											// Set FLL Div = fDCOCLK/2
+											// (749 + 1) * 32768 = 24.576MHz
+											// Set FLL Div = fDCOCLK/1
 
-	UCSCTL4  |= (0x03 << 4);				// Set SMCLK to DCO (12.28 MHz)
-	// UCSCTL6 &= ~BIT8;					// SMCLK - 4 MHz (unresolved problem: XT2 seems to be running at 1 MHz rather than 4 MHz)
+	UCSCTL4  = SELA_2 | SELS_4 | SELM_4;	// ACLK = REFO, SMCLK = MCLK = DCOCLKDIV
 
 	__bic_SR_register(SCG0);                // Enable the FLL control loop
 
+	// Worst-case settling time for the DCO when the range is changed is
+	//   n x 32 x 32 x f_MCLK / f_FLL_reference, with n = 1 for FLLD_0;
+	//   clear the fault flags until the DCO has locked
+	do
+	{
+		UCSCTL7 &= ~( XT2OFFG + XT1LFOFFG + DCOFFG );
+		SFRIFG1 &= ~OFIFG;
+	} while( SFRIFG1 & OFIFG );
+
 	return;
 }
 //============================================================================
@@ -98,8 +157,8 @@ void init_timer_A0( void )
 	TA0CTL |=  TAIE;
 
 
-	// Set Compare register (12300 yields an interrupt about every 1 ms)
-	 TA0CCR0 = MAX_INTENSITY;
+	// Set Compare register (one PWM period yields an interrupt every 1 ms)
+	 TA0CCR0 = PWM_PERIOD;
 
 	__enable_interrupt();				//Interrupts Enabled
 
@@ -142,10 +201,81 @@ void delay_ms( uint32_t delay_ms )
 
 
 
+/*init_timestamp
+* Starts Timer B0 free-running from SMCLK / 24 (exactly 1.024 MHz with the
+*   32768 Hz FLL reference), or from SMCLK when profiling. Its overflow
+*   interrupt extends it to 32 bits, which wraps after about 70 minutes
+* INPUT: None
+* RETURN: None
+*/
+void init_timestamp( void )
+{
+	tstamp_hi = 0;
+
+	TB0CTL  = TBSSEL_2 | TSTAMP_ID | TBCLR;		// SMCLK, first divider, stopped
+	TB0EX0  = TSTAMP_IDEX;						// Second divider
+	TB0CTL |= MC_2 | TBIE;						// Continuous mode, overflow interrupt
+
+	return;
+}
+//============================================================================
+
+
+
+/*tstamp_now
+* Reads the 32-bit timestamp (TSTAMP_TICKS_PER_MS ticks per ms). Safe from any
+*   context - an overflow that hasn't been serviced yet is accounted for
+* INPUT: None
+* RETURN: Timestamp (ticks)
+*/
+uint32_t tstamp_now( void )
+{
+	uint16_t state = __get_interrupt_state();
+	uint16_t hi;
+	uint16_t lo;
+
+	__disable_interrupt();
+
+	hi = tstamp_hi;
+	lo = TB0R;
+
+	// Counter wrapped after the last overflow interrupt ran
+	if( ( TB0CTL & TBIFG ) && lo < 0x8000 )
+	{
+		hi++;
+	}
+
+	__set_interrupt_state( state );
+
+	return ( (uint32_t)hi << 16 ) | lo;
+}
+//============================================================================
+
+
+
+/*tstamp_to_us
+* Converts a number of timestamp ticks (usually the difference between two
+*   tstamp_now() readings) to microseconds, 1 tick = 125/128 us (125/3072 us
+*   when profiling)
+* INPUT: Ticks
+* RETURN: Microseconds
+*/
+uint32_t tstamp_to_us( uint32_t ticks )
+{
+#ifdef PROFILE
+	return ( ticks / 3072 ) * 125 + ( ( ticks % 3072 ) * 125 ) / 3072;
+#else
+	return ( ticks >> 7 ) * 125 + ( ( ( ticks & 0x7F ) * 125 ) >> 7 );
+#endif
+}
+//============================================================================
+
+
+
 void initWaitTimer(void)
 {
   TA1CTL = TASSEL_2 + MC_1+TACLR;
-  TA1CCR0 =  123; //12.28 MHz/12 ~ 1us
+  TA1CCR0 =  TMR_COUNTS_PER_10US; // 10 us
 
   TA1CCTL0 &= ~CCIE; // disable timer
 
@@ -157,12 +287,24 @@ void initWaitTimer(void)
 
 void delay_10us( uint32_t time_10us )
 {
+	uint16_t chunk;
+
 	TA1R = 60;
-	timer_flag = FALSE;
-	TA1CCR0 =  123 * time_10us;
 	TA1CCTL0 |= CCIE; // enable timer
 
-	while( timer_flag == FALSE );
+	// The compare register can't hold a long delay at this clock, so it is
+	//   waited out a STEP_CHUNK_10US piece at a time (the timer carries on
+	//   from 0 after each)
+	while( time_10us > 0 )
+	{
+		chunk = ( time_10us > STEP_CHUNK_10US ) ? STEP_CHUNK_10US : (uint16_t)time_10us;
+		time_10us -= chunk;
+
+		timer_flag = FALSE;
+		TA1CCR0 =  TMR_COUNTS_PER_10US * chunk;
+
+		while( timer_flag == FALSE ) { HAL_IDLE(); }
+	}
 
 	TA1CCTL0 &= ~CCIE; // disable timer
 
@@ -176,12 +318,37 @@ void delay_10us( uint32_t time_10us )
 #pragma vector = TIMER0_A1_VECTOR
 __interrupt void TIMERA0_ISR(void)
 {
+	uint16_t events;
+	PROF_ENTER( PROF_ISR_TICK );
+
 	switch( __even_in_range( TA0IV, 14 ) )
 	{
 		case TA0IV_TAIFG: time_ms++;
+
+						  events = EV_TICK;
+						  if( sample_lid_safety()  == TRUE ) { events |= EV_LID;  }
+						  if( service_burn_timer() == TRUE ) { events |= EV_BURN; }
+
+						  POST_EVENT_FROM_ISR( events );
 				 	 	  break;
 		default: 		  break;
 	}
+
+	PROF_EXIT( PROF_ISR_TICK );
+}
+//============================================================================
+
+
+
+#pragma vector = TIMER0_B1_VECTOR
+__interrupt void TIMERB0_ISR(void)
+{
+	switch( __even_in_range( TB0IV, 14 ) )
+	{
+		case TB0IV_TBIFG: tstamp_hi++;
+						  break;
+		default: 		  break;
+	}
 }
 //============================================================================
 
@@ -18,6 +18,7 @@
 
 
 #include <stdio.h>
+#include <stdint.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -26,6 +27,10 @@ void init_clocks( void );
 void init_timer_A0( void );
 void delay_ms( uint32_t time_ms );
 
+void init_timestamp( void );
+uint32_t tstamp_now( void );
+uint32_t tstamp_to_us( uint32_t ticks );
+
 
 /*initWaitTimer
 
@@ -14,47 +14,123 @@
 
 #include <stdio.h>
 
-#include "msp430f5529.h"
+#include "hal.h"
 #include "defs.h"
 #include "uart_fifo.h"
 #include "time.h"
 #include "laser_driver.h"
 #include "motors.h"
+#include "scheduler.h"
+#include "ring.h"
+#include "job.h"
+#include "bytecode.h"
+#include "stats.h"
+#include "profile.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 
 
-volatile uint8_t tx_char;			//This char is the most current char to go into the UART
-
-volatile uint8_t rx_flag;			//Mailbox Flag for the rx_char.
 volatile uint8_t rx_char;			//This char is the most current char to come out of the UART
 
-volatile uint8_t tx_fifo[FIFO_SIZE];  //The array for the tx fifo
-volatile uint8_t rx_fifo[FIFO_SIZE];  //The array for the rx fifo
+static volatile uint8_t tx_fifo[TX_FIFO_SIZE];  //The array for the tx fifo
+static volatile uint8_t rx_fifo[RX_FIFO_SIZE];  //The array for the rx fifo
+
+// Filled by the main program and emptied by the TX interrupt
+static struct TRing tx_ring;
+
+// Filled by the RX interrupt and emptied by the main program. Only frames are
+//   kept, and each frame's chars are committed together once its ETX arrives,
+//   after which its length goes in rx_frame_ring
+static struct TRing rx_ring;
+
+static volatile uint8_t rx_frame_len[RX_FRAME_QUEUE_SIZE];
+static struct TRing rx_frame_ring;
 
-volatile uint16_t tx_fifo_ptA;			//Theses pointers keep track where the UART and the Main program are in the Fifos
-volatile uint16_t tx_fifo_ptB;
-volatile uint16_t rx_fifo_ptA;
-volatile uint16_t rx_fifo_ptB;
+// ACKs / NAKs (command, then ack byte) the tx fifo had no room for, sent in
+//   order once it has
+static volatile uint8_t ack_queue[ACK_QUEUE_SIZE][2];
+static struct TRing ack_ring;
 
-volatile uint8_t rx_fifo_full;
-volatile uint8_t tx_fifo_full;
+// packet_ip states
+#define RX_IDLE				0			// Between frames
+#define RX_IN_FRAME			1			// Storing a frame
+#define RX_SKIP_FRAME		2			// Skipping the rest of a frame dropped for lack of room
 
-volatile uint8_t packet_ip;
-volatile uint8_t packet_ready;
+static uint8_t rx_frame_size;				// Chars of the frame in progress written (not yet committed)
+static uint8_t rx_escape;					// Last char of the frame in progress was an unescaped ESC
+
+volatile uint16_t rx_overruns = 0;		// Frames dropped because the rx fifo or frame queue was full (or too long)
+volatile uint16_t rx_resyncs  = 0;		// Partial frames dropped because a new STX arrived
+volatile uint16_t tx_overruns = 0;		// Chars / packets refused because the tx fifo had no room
+
+volatile uint8_t packet_ip;				// RX_x state of the frame being received
 
-volatile uint8_t burn_ready = FALSE;
 volatile uint8_t picture_ip = FALSE;
 volatile uint8_t pi_init    = FALSE;
 volatile uint8_t first_pixel = FALSE;
+volatile uint8_t start_pending = FALSE;		// CMD_START received, waiting on the lid
+volatile uint8_t end_pending   = FALSE;		// CMD_END received, waiting on the burns still queued
+volatile uint8_t home_pending  = FALSE;		// Homing for the burn task to do (it can't be done in here)
+
+extern uint32_t burns_done;
+extern uint8_t  picture_halted;
+
+// Command that started the picture (CMD_START, CMD_RESUME, or CMD_JOB_RUN to burn the job in flash)
+static uint8_t start_cmd = CMD_START;
+
+// Messages sent to the Pi that are resent until it acknowledges them, one
+//   slot per message type
+#define RETX_READY			0
+#define RETX_INIT			1
+#define RETX_EMERGENCY		2
+#define RETX_PROGRESS		3
+#define RETX_SLOTS			4
+
+struct TRetx_Msg
+{
+	struct TPacket_Data tx_data;	// Message to (re)send
+	uint8_t  active;				// Waiting on the acknowledgement
+	uint8_t  attempts;				// Times the message has been sent
+	uint8_t  max_attempts;			// RETX_FOREVER to keep resending until acknowledged
+	uint16_t timeout;				// ms to wait on the last attempt before resending
+	uint32_t sent_time;				// time_ms of the last attempt
+	uint8_t  unsent;				// The tx fifo had no room for the last attempt - try it again
+	void ( *on_fail )( void );		// Called once max_attempts have gone unanswered (may be 0)
+};
+
+static struct TRetx_Msg retx[RETX_SLOTS];
+
+// A queued burn command hasn't been answered with a ready request yet
+static uint8_t ready_owed = FALSE;
+
+// Dump being streamed to the Pi a packet per comm_task pass
+#define DUMP_NONE			0
+#define DUMP_TRACE			1
+#define DUMP_STATS			2
+#define DUMP_PROFILE		3
+
+static uint8_t  dump_type = DUMP_NONE;
+static uint16_t dump_next;					// Trace event / table index of the next packet
+static uint16_t dump_end;					// Index past the last one, the end command is sent there
+static uint8_t  dump_reset;					// Reset the table once it has all been sent
 
 extern volatile uint32_t time_ms;
 extern volatile uint8_t door_opened;
+extern volatile uint8_t lid_open;
+extern volatile uint8_t laser_ready;
 
 volatile uint32_t last_rx_time 	     = UINT32_MAX;
 volatile uint32_t pixel_request_time = UINT32_MAX;
 
+static void retx_send( uint8_t slot, struct TPacket_Data * tx_data, uint8_t max_attempts, void ( *on_fail )( void ) );
+static void retx_response( uint8_t command, uint8_t ack );
+static void service_retransmits( void );
+static uint8_t uart_putp_resend( uint8_t *packet, uint16_t length );
+static void service_acks( void );
+static uint8_t start_dump( uint8_t type, uint8_t reset );
+static void service_dump( void );
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -72,31 +148,25 @@ void init_uart(void)
 	UCA1CTL1 |= BIT0;					// Hold UART in reset while modifying settings
 
 
-										// 12,000,000Hz, 115200Baud, UCBRx=106, UCBRSx=6, UCBRFx=0, no oversampling
+										// Baud rate settings for SMCLK_HZ are in defs.h
 	UCA1CTL1 |= ( BIT7 | BIT6 );		// Set UART clock to SMCLK
-	UCA1BR0   = 106;
-	UCA1BR1   = 0;
-	UCA1MCTL  = (0 << 4) | (6 << 1) | (0); 			//UCBRFx=0, UCBRSx=6, UCOS16=0
+	UCA1BR0   = UCA1_BR0;
+	UCA1BR1   = UCA1_BR1;
+	UCA1MCTL  = ( UCA1_BRF << 4 ) | ( UCA1_BRS << 1 ) | ( UCA1_OS );
 
 	UCA1CTL1 &= ~(BIT0); 				//USCI state machine - disable software reset capabilities
 	UCA1IE   |= BIT0; 					//Enable USCI_A0 RX interrupt
 
 
 	// Variable initialization
-	rx_flag = 0;						//Set rx_flag to 0
-
-	tx_fifo_ptA = 0;					//Set the fifo pointers to 0
-	tx_fifo_ptB = 0;
-	rx_fifo_ptA = 0;
-	rx_fifo_ptB = 0;
+	ring_init( &tx_ring, tx_fifo, TX_FIFO_SIZE, 1 );
+	ring_init( &rx_ring, rx_fifo, RX_FIFO_SIZE, 1 );
+	ring_init( &rx_frame_ring, rx_frame_len, RX_FRAME_QUEUE_SIZE, 1 );
+	ring_init( &ack_ring, ack_queue, ACK_QUEUE_SIZE, 2 );
 
-	tx_fifo_full = 0;
-	rx_fifo_full = 0;
-
-	packet_ip    = 0;
-	packet_ready = 0;
-
-	burn_ready = FALSE;
+	rx_frame_size = 0;
+	rx_escape     = 0;
+	packet_ip     = RX_IDLE;
 
 	__enable_interrupt();				//Interrupts Enabled
 
@@ -110,7 +180,8 @@ void init_uart(void)
 
 
 /*uart_getc
-* Get a char from the UART. Waits till it gets one
+* Get a char from the UART. Waits till it gets one. Only whole frames reach the
+*   rx fifo, and this is not to be mixed with uart_getp(), which takes them by frame
 * INPUT: None
 * RETURN: Char from UART
 */
@@ -118,20 +189,8 @@ uint8_t uart_getc()					// Waits for a valid char from the UART
 {
 	uint8_t c;
 
-	while (rx_flag == 0);		 			// Wait for rx_flag to be set
+	while( ring_pop( &rx_ring, &c ) == FALSE ) { HAL_IDLE(); }	// Wait for a char
 
-	c = rx_fifo[rx_fifo_ptA];				// Copy the fifo
-	rx_fifo_ptA++;							// Increase the fifo pointer
-
-	if(rx_fifo_ptA == FIFO_SIZE)			// If pointer is equal to the max size roll it over
-	{
-		rx_fifo_ptA = 0;
-	}
-
-	if(rx_fifo_ptA == rx_fifo_ptB)			// If the pointers are the same we have no new data
-	{
-		rx_flag = 0;						// ACK rx_flag
-	}
     return c;
 }
 //============================================================================
@@ -168,82 +227,92 @@ void uart_gets(char* Array, uint16_t length)
 
 
 
+/*uart_packets_ready
+* INPUT: None
+* RETURN: Number of complete packets waiting in the rx fifo
+*/
+uint16_t uart_packets_ready( void )
+{
+	return ring_count( &rx_frame_ring );
+}
+//============================================================================
+
+
+
 /*uart_getp
-* Get a packet of unknown length from the UART. Strings terminate when ETX character is received or string buffer fills
-* Will return number of bytes in the packet when all the chars are received. Waits for the data.
+* Takes the oldest complete frame (STX to ETX) out of the rx fifo. Waits for one
+*   if there are none - check uart_packets_ready() first to avoid waiting. A frame
+*   longer than max_length is cut short (it fails parsing), and the rest is discarded
 * INPUT: Array pointer and length
-* RETURN: None
+* RETURN: Number of bytes copied to the array
 */
 uint16_t uart_getp( uint8_t* packet, uint16_t max_length )
 {
-	uint16_t i = 0;
-	uint8_t temp_char;
-	uint8_t message_started = 0;
-	// Grab data till the array fills
-	for( i = 0; i < max_length; i++ )
-	{
-		if( message_started == 0 )
-		{
-			temp_char = uart_getc();
-			if( temp_char == STX )
-			{
-				message_started = 1;
-				packet[i] = temp_char;
-			}
-			else
-			{
-				i--;
-			}
-		}
-		else
-		{
-			packet[i] = uart_getc();
-		}
+	uint8_t length;
+	uint16_t copy_length;
+	uint16_t i;
+	PROF_ENTER( PROF_UART_GETP );
 
-		//If we receive an unescaped ETX the master wants to end
-		if( packet[i] == ETX )
-		{
-			uint16_t esc_count = 0;
-			while( esc_count < i && packet[ i - esc_count - 1 ] == ESC ) { esc_count++; }
+	while( ring_pop( &rx_frame_ring, &length ) == FALSE ) { HAL_IDLE(); }	// Wait for a complete frame
 
-			if( esc_count % 2 == 0 )
-			{
-				return i+1;
-			}
-		}
+	copy_length = ( length > max_length ) ? max_length : length;
+
+	for( i = 0; i < copy_length; i++ )
+	{
+		ring_peek( &rx_ring, i, &packet[i] );
 	}
 
-	printf( "Message Received");
+	ring_release( &rx_ring, length );
+
+	PROF_EXIT( PROF_UART_GETP );
+    return copy_length;
+}
+//============================================================================
+
 
-    return max_length;
+
+/*uart_tx_free
+* Room left in the tx fifo
+* INPUT: None
+* RETURN: Number of chars that can be queued without waiting
+*/
+uint16_t uart_tx_free( void )
+{
+	return ring_free( &tx_ring );
 }
 //============================================================================
 
 
 
 /*uart_putc
-* Sends a char to the UART. Will wait if the UART is busy
+* Queues a char for the UART. Never waits - the char is refused if the tx fifo is full
 * INPUT: Char to send
-* RETURN: None
+* RETURN: TRUE if queued, FALSE if there was no room
 */
-void uart_putc(uint8_t c)
+uint8_t uart_putc(uint8_t c)
 {
-	tx_char = c;						//Put the char into the tx_char
-	tx_fifo[tx_fifo_ptA] = tx_char;		//Put the tx_char into the fifo
-	tx_fifo_ptA++;						//Increase the fifo pointer
-	if(tx_fifo_ptA == FIFO_SIZE)		//Check to see if the pointer is max size. If so roll it over
+	if( ring_push( &tx_ring, &c ) == FALSE )
 	{
-		tx_fifo_ptA = 0;
-	}
-	if(tx_fifo_ptB == tx_fifo_ptA)		//fifo full
-	{
-		tx_fifo_full = 1;
-	}
-	else
-	{
-		tx_fifo_full = 0;
+		tx_overruns++;
+		return FALSE;
 	}
+
 	UCA1IE |= BIT1; 					//Enable USCI_A0 TX interrupt
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*uart_flush
+* Waits until every queued char has been handed to the UART
+* INPUT: None
+* RETURN: None
+*/
+void uart_flush( void )
+{
+	while( ring_count( &tx_ring ) > 0 ) { HAL_IDLE(); }	// TX interrupt empties the fifo
+
 	return;
 }
 //============================================================================
@@ -251,7 +320,7 @@ void uart_putc(uint8_t c)
 
 
 /*uart_puts
-* Sends a string to the UART. Will wait if the UART is busy
+* Sends a string to the UART. Never waits - chars that don't fit are dropped
 * INPUT: Pointer to String to send
 * RETURN: None
 */
@@ -265,19 +334,50 @@ void uart_puts(char *str)				//Sends a String to the UART.
 
 
 /*uart_putp
-* Sends a string to the UART. Will wait if the UART is busy
-* INPUT: Pointer to String to send
-* RETURN: None
+* Queues a whole packet for the UART, or none of it if the tx fifo doesn't have
+*   room, so a burst never leaves a partial frame on the line. Never waits
+* INPUT: Pointer to packet to send and its length
+* RETURN: TRUE if queued, FALSE if there was no room (nothing was queued)
 */
-void uart_putp( uint8_t *packet, uint16_t length )					//Sends a String to the UART.
+uint8_t uart_putp( uint8_t *packet, uint16_t length )
 {
 	uint16_t i;
+
+	if( ring_free( &tx_ring ) < length )
+	{
+		tx_overruns++;
+		return FALSE;
+	}
+
 	for( i = 0; i < length; i++ )
 	{
-		uart_putc( packet[i] );
+		ring_write( &tx_ring, i, &packet[i] );
 	}
 
-     return;
+	ring_commit( &tx_ring, length );	// Publish the whole packet to the TX interrupt at once
+
+	UCA1IE |= BIT1; 					//Enable USCI_A0 TX interrupt
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*uart_putp_resend
+* Queues a packet held back for lack of room (one uart_putp() has already
+*   refused, or the next dump packet), if the tx fifo now has room for it.
+*   Finding no room isn't counted as another tx overrun
+* INPUT: Pointer to packet to send and its length
+* RETURN: TRUE if queued, FALSE if there was no room (nothing was queued)
+*/
+static uint8_t uart_putp_resend( uint8_t *packet, uint16_t length )
+{
+	if( ring_free( &tx_ring ) < length )
+	{
+		return FALSE;
+	}
+
+	return uart_putp( packet, length );
 }
 //============================================================================
 
@@ -349,7 +449,18 @@ uint16_t parse_rx_packet( uint8_t *rx_buff, uint16_t length, struct TPacket_Data
 			case CMD_BURN  : rx_data->data_size = CMD_BURN_PAYLOAD_SIZE;	break;
 			case CMD_START : rx_data->data_size = CMD_START_PAYLOAD_SIZE;	break;
 			case CMD_END   : rx_data->data_size = CMD_END_PAYLOAD_SIZE;		break;
+			case CMD_RESUME: rx_data->data_size = CMD_RESUME_PAYLOAD_SIZE;	break;
 			case CMD_INIT  : rx_data->data_size = CMD_INIT_PAYLOAD_SIZE;	break;
+			case CMD_TRACE : rx_data->data_size = CMD_TRACE_PAYLOAD_SIZE;	break;
+			case CMD_JOB_BEGIN : rx_data->data_size = CMD_JOB_BEGIN_PAYLOAD_SIZE;	break;
+			case CMD_JOB_DATA  : rx_data->data_size = CMD_JOB_DATA_PAYLOAD_SIZE;	break;
+			case CMD_JOB_END   : rx_data->data_size = CMD_JOB_END_PAYLOAD_SIZE;		break;
+			case CMD_JOB_RUN   : rx_data->data_size = CMD_JOB_RUN_PAYLOAD_SIZE;		break;
+			case CMD_CODE      : rx_data->data_size = CMD_CODE_PAYLOAD_SIZE;		break;
+			case CMD_STATS     : rx_data->data_size = CMD_STATS_PAYLOAD_SIZE;		break;
+#ifdef PROFILE
+			case CMD_PROFILE   : rx_data->data_size = CMD_PROFILE_PAYLOAD_SIZE;		break;
+#endif
 			
 			// If command not recognized, return an error
 			default		   : rx_data->command = NAK_MSG;
@@ -364,6 +475,7 @@ uint16_t parse_rx_packet( uint8_t *rx_buff, uint16_t length, struct TPacket_Data
 			case CMD_PIXEL_READY :	rx_data->data_size = CMD_READY_RESPONSE_SIZE;	break;
 			case CMD_EMERGENCY   :	rx_data->data_size = CMD_EMERG_RESPONSE_SIZE;	break;
 			case CMD_INIT    	 :	rx_data->data_size = CMD_INIT_RESPONSE_SIZE;	break;
+			case CMD_PROGRESS	 :	rx_data->data_size = CMD_PROGRESS_RESPONSE_SIZE;	break;
 
 			// If command not recognized, return an error
 			default		         : 	rx_data->command = NAK_MSG;
@@ -519,7 +631,9 @@ uint16_t pack_tx_packet( struct TPacket_Data tx_data, uint8_t * tx_buff )
 void parse_burn_cmd_payload( uint8_t * burn_cmd_payload,
 							 uint32_t * yLocation,
 							 uint32_t * xLocation,
-							 uint32_t * laserInt )
+							 uint32_t * laserInt,
+							 uint8_t  * keepOn,
+							 uint8_t  * dither )
 {
 	uint32_t combinedPacket  = 0;
 	uint32_t combinedPacket2 = 0;
@@ -528,6 +642,7 @@ void parse_burn_cmd_payload( uint8_t * burn_cmd_payload,
 	volatile uint32_t tempy;
 	volatile uint32_t tempx;
 	volatile uint32_t tempint;
+	PROF_ENTER( PROF_PARSE_BURN );
 
 	// Data stored with LSB first
 	combinedPacket |= (uint32_t)burn_cmd_payload[i];
@@ -565,6 +680,18 @@ void parse_burn_cmd_payload( uint8_t * burn_cmd_payload,
 
 	tempint = *laserInt;
 
+	// Set keep-on flag (laser stays on while moving to the next coordinate)
+	*keepOn = ( ( combinedPacket & KEEP_ON_MASK ) != 0 ) ? TRUE : FALSE;
+
+	// In dither mode the laser intensity is replaced by a wider gray value
+	*dither = ( ( combinedPacket & DITHER_MASK ) != 0 ) ? TRUE : FALSE;
+
+	if( *dither == TRUE )
+	{
+		*laserInt = ( combinedPacket & DITHER_GRAY_MASK ) >> DITHER_GRAY_SHIFT;
+	}
+
+	PROF_EXIT( PROF_PARSE_BURN );
 	return;
 }
 //============================================================================
@@ -587,9 +714,15 @@ uint8_t calc_8bit_mod_checksum( uint8_t *data, uint16_t length )
 
 
 
+/*check_and_respond_to_msg
+* Handles one packet if a complete one is waiting, otherwise checks the pixel
+*   timeout. Never waits on the Pi
+* INPUT: Structure to copy the parsed packet to (may be 0)
+* RETURN: None
+*/
 void check_and_respond_to_msg( struct TPacket_Data * rx_data )
 {
-	if( packet_ready == 1 )
+	if( uart_packets_ready() > 0 )
 	{
 		last_rx_time = time_ms;
 
@@ -597,63 +730,119 @@ void check_and_respond_to_msg( struct TPacket_Data * rx_data )
 
 		struct TPacket_Data lrx_data;
 		uint16_t rx_size = uart_getp( rx_packet, MAX_PACKET_LENGTH );
-		if( parse_rx_packet( rx_packet, rx_size, &lrx_data ) == 0 )
+		stats[STAT_RX_PACKETS]++;
+
+		// Timed here, as parse_rx_packet has a return for every kind of bad packet
+		PROF_ENTER( PROF_PARSE_RX );
+		uint16_t rx_error = parse_rx_packet( rx_packet, rx_size, &lrx_data );
+		PROF_EXIT( PROF_PARSE_RX );
+
+		if( rx_error == 0 )
 		{
 			// If not a new command, it the Pi is acknowledging a message -> Don't respond
 			if( lrx_data.ack == NEW_CMD )
 			{
 				if( lrx_data.command == CMD_BURN )
 				{
-					send_ack( lrx_data.command, ACK_MSG );
-					burn_ready = TRUE;
+					// Parse it into the burn queue now, so it can start as soon as the
+					//   burn in progress is done (the first burn is held there until the
+					//   power-up warm-up has finished)
+					if( queue_burn_cmd( lrx_data.data ) == TRUE )
+					{
+						send_ack( lrx_data.command, ACK_MSG );
+						ready_owed = TRUE;
+					}
+					else
+					{
+						// No room - the Pi sends it again
+						send_ack( lrx_data.command, NAK_MSG );
+					}
+
 					pixel_request_time = UINT32_MAX;
 
-					if( first_pixel == TRUE )
+					// A new burn means the Pi got the ready request, even if its ACK was lost
+					retx[RETX_READY].active = FALSE;
+				}
+				else if( lrx_data.command == CMD_START )
+				{
+					// Acknowledged by service_start_request() once the lid allows it
+					start_cmd     = CMD_START;
+					start_pending = TRUE;
+					service_start_request();
+				}
+				else if( lrx_data.command == CMD_RESUME )
+				{
+					// During a picture, releases the lid interlock once the lid is closed
+					if( picture_ip == TRUE )
+					{
+						send_ack( lrx_data.command, ( lid_resume() == TRUE ) ? ACK_MSG : NAK_MSG );
+					}
+					// Only a halted picture can be carried on
+					else if( picture_halted == TRUE )
 					{
-						enable_laser();
-						delay_ms( 1 );
-						first_pixel = FALSE;
+						start_cmd     = CMD_RESUME;
+						start_pending = TRUE;
+						service_start_request();
+					}
+					else
+					{
+						send_ack( lrx_data.command, NAK_MSG );
 					}
 				}
-				else if( lrx_data.command == CMD_START )
+				else if( lrx_data.command == CMD_JOB_RUN )
 				{
-					// Make sure the door isn't currently open
-					while( !( P6IN & LID_OPEN ) );
-
-					if( door_opened == FALSE )
+					// As CMD_START, but the burns come from the job in flash
+					if( job_valid() == TRUE && picture_ip == FALSE )
 					{
-						// If the door hasn't been opened yet, wait for it to open (then close)
-						while( P6IN & LID_OPEN );
-						door_opened = TRUE;
-						while( !( P6IN & LID_OPEN ) );
+						start_cmd     = CMD_JOB_RUN;
+						start_pending = TRUE;
+						service_start_request();
 					}
-
-					send_ack( lrx_data.command, ACK_MSG );
-
-					picture_ip = TRUE;
-					burn_ready = FALSE;
-					first_pixel = TRUE;
-
-					// Since a burn pixel command should be imminent, start the timer for the timeout
-					//pixel_request_time = time_ms;
-
-					homeLaser();
+					else
+					{
+						send_ack( lrx_data.command, NAK_MSG );
+					}
+				}
+				else if( lrx_data.command == CMD_JOB_BEGIN )
+				{
+					send_ack( lrx_data.command, ( job_begin() == TRUE ) ? ACK_MSG : NAK_MSG );
+				}
+				else if( lrx_data.command == CMD_JOB_DATA )
+				{
+					send_ack( lrx_data.command, ( job_data( lrx_data.data ) == TRUE ) ? ACK_MSG : NAK_MSG );
+				}
+				else if( lrx_data.command == CMD_JOB_END )
+				{
+					send_ack( lrx_data.command, ( job_end( lrx_data.data ) == TRUE ) ? ACK_MSG : NAK_MSG );
+				}
+				else if( lrx_data.command == CMD_CODE )
+				{
+					// No room - the Pi sends it again once the program has run on
+					send_ack( lrx_data.command, ( code_put( lrx_data.data ) == TRUE ) ? ACK_MSG : NAK_MSG );
 				}
 				else if( lrx_data.command == CMD_END )
 				{
 					send_ack( lrx_data.command, ACK_MSG );
-					disable_laser();
-					picture_ip = FALSE;
+					pixel_request_time = UINT32_MAX;
+					retx[RETX_READY].active = FALSE;
+					ready_owed = FALSE;
 
-					homeLaser();
-					door_opened = FALSE;
+					// Pixels are requested ahead, so let the ones still queued finish first
+					end_pending = TRUE;
+					service_end_request();
 				}
 				else if( lrx_data.command == CMD_INIT )
 				{
-					if( pi_init == TRUE );
+					// The Pi has lost its place - stop, and report how far the picture got
+					if( picture_ip == TRUE ) { halt_burn(); }
+
+					// Homing is done at power-up, so only re-home if the Pi is re-initializing
+					if( pi_init == TRUE )
 					{
-						disable_laser();
-						homeLaser();
+						// Don't cut the power-up warm-up short
+						if( laser_ready == TRUE ) { disable_laser(); }
+
+						home_pending = TRUE;
 
 						// Don't send here (for fear of small chance of infinite recursion)
 						//   Instead, do this in main loop (if 'pi_init == JUST_INITIALIZED')
@@ -663,30 +852,55 @@ void check_and_respond_to_msg( struct TPacket_Data * rx_data )
 					send_ack( lrx_data.command, ACK_MSG );
 					pi_init = JUST_INITIALIZED;
 				}
+				else if( lrx_data.command == CMD_TRACE )
+				{
+					// Only one dump is sent at a time
+					send_ack( lrx_data.command, ( start_dump( DUMP_TRACE, FALSE ) == TRUE ) ? ACK_MSG : NAK_MSG );
+				}
+				else if( lrx_data.command == CMD_STATS )
+				{
+					send_ack( lrx_data.command, ( start_dump( DUMP_STATS, lrx_data.data[0] ) == TRUE ) ? ACK_MSG : NAK_MSG );
+				}
+#ifdef PROFILE
+				else if( lrx_data.command == CMD_PROFILE )
+				{
+					send_ack( lrx_data.command, ( start_dump( DUMP_PROFILE, lrx_data.data[0] ) == TRUE ) ? ACK_MSG : NAK_MSG );
+				}
+#endif
 				else
 				{
 					// Bad commands should be caught in the parsing function
 					send_ack( lrx_data.command, NAK_MSG );
 				}
 			}
+			else
+			{
+				// The Pi is answering one of the messages waiting to be acknowledged
+				retx_response( lrx_data.command, lrx_data.ack );
+			}
 		}
 		else
 		{
+			stats[STAT_RX_ERRORS]++;
 			send_ack( lrx_data.command, NAK_MSG );
 		}
 
 		if( rx_data != 0 ) { *rx_data = lrx_data; }
-		
-		//packet_ready = 0;
 	}
 	else
 	{
 		if( pixel_request_time != UINT32_MAX )
 		{
+			// Only count the time the burn has been left with nothing to do once the
+			//   Pi has the request (until then, the retransmits decide when to give up)
+			if( burn_busy() == TRUE || retx[RETX_READY].active == TRUE ) { pixel_request_time = time_ms; }
+
 			volatile int32_t time_since_rq = time_ms - pixel_request_time;
 
 			if( time_since_rq > PIXEL_TIMEOUT )
 			{
+				stats[STAT_PIXEL_TIMEOUTS]++;
+				pixel_request_time = UINT32_MAX;
 				halt_burn();
 			}
 		}
@@ -699,6 +913,192 @@ void check_and_respond_to_msg( struct TPacket_Data * rx_data )
 
 
 
+/*retx_transmit
+* Sends a message waiting to be acknowledged and restarts its timeout. If the
+*   tx fifo has no room, the message is left unsent for service_retransmits()
+*   to try again, and the attempt isn't counted
+* INPUT: Message to send
+* RETURN: None
+*/
+static void retx_transmit( struct TRetx_Msg * msg )
+{
+	uint8_t tx_buff[MAX_PACKET_LENGTH];
+	uint16_t tx_length = pack_tx_packet( msg->tx_data, tx_buff );
+	uint8_t sent;
+
+	sent = ( msg->unsent == TRUE ) ? uart_putp_resend( tx_buff, tx_length ) : uart_putp( tx_buff, tx_length );
+	msg->unsent = ( sent == TRUE ) ? FALSE : TRUE;
+
+	if( sent == FALSE )
+	{
+		return;
+	}
+
+	msg->attempts++;
+	msg->sent_time = time_ms;
+
+	return;
+}
+//============================================================================
+
+
+
+/*retx_send
+* Sends a message and keeps resending it, with a backed-off timeout, until
+*   the Pi acknowledges it. Replaces the message already waiting in the slot
+* INPUT: Slot for the message type (RETX_x), message to send, attempts before
+*   giving up (RETX_FOREVER to never give up), and function to call when giving
+*   up (may be 0)
+* RETURN: None
+*/
+static void retx_send( uint8_t slot, struct TPacket_Data * tx_data, uint8_t max_attempts, void ( *on_fail )( void ) )
+{
+	struct TRetx_Msg * msg = &retx[slot];
+
+	msg->tx_data      = *tx_data;
+	msg->attempts     = 0;
+	msg->max_attempts = max_attempts;
+	msg->timeout      = RETX_TIMEOUT;
+	msg->on_fail      = on_fail;
+	msg->unsent       = FALSE;
+	msg->active       = TRUE;
+
+	retx_transmit( msg );
+
+	return;
+}
+//============================================================================
+
+
+
+/*retx_retry
+* Resends a message that went unanswered, doubling its timeout, or gives up
+*   on it once max_attempts have been made
+* INPUT: Message to resend
+* RETURN: None
+*/
+static void retx_retry( struct TRetx_Msg * msg )
+{
+	if( msg->max_attempts != RETX_FOREVER && msg->attempts >= msg->max_attempts )
+	{
+		stats[STAT_RETX_FAILURES]++;
+		msg->active = FALSE;
+		if( msg->on_fail != 0 ) { msg->on_fail(); }
+		return;
+	}
+
+	msg->timeout = ( msg->timeout >= RETX_MAX_TIMEOUT / 2 ) ? RETX_MAX_TIMEOUT : msg->timeout * 2;
+
+	stats[STAT_RESENDS]++;
+	if( msg->tx_data.command == CMD_PIXEL_READY ) { stats[STAT_READY_RESENDS]++; }
+
+	retx_transmit( msg );
+
+	return;
+}
+//============================================================================
+
+
+
+/*retx_response
+* Matches an ACK / NAK from the Pi to the message waiting on it. An ACK
+*   completes the message, a NAK resends it straight away
+* INPUT: Command and ack byte of the received packet
+* RETURN: None
+*/
+static void retx_response( uint8_t command, uint8_t ack )
+{
+	uint8_t i;
+
+	if( ack == NAK_MSG ) { stats[STAT_NAKS_RECEIVED]++; }
+
+	for( i = 0; i < RETX_SLOTS; i++ )
+	{
+		if( retx[i].active == TRUE && retx[i].tx_data.command == command )
+		{
+			if( ack == ACK_MSG ) { retx[i].active = FALSE; }
+			else                 { retx_retry( &retx[i] ); }
+		}
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*service_retransmits
+* Sends every message the tx fifo had no room for, and resends every message
+*   whose acknowledgement has timed out
+* INPUT: None
+* RETURN: None
+*/
+static void service_retransmits( void )
+{
+	uint8_t i;
+
+	for( i = 0; i < RETX_SLOTS; i++ )
+	{
+		if( retx[i].active == TRUE && retx[i].unsent == TRUE )
+		{
+			retx_transmit( &retx[i] );
+		}
+		else if( retx[i].active == TRUE && ( time_ms - retx[i].sent_time ) >= retx[i].timeout )
+		{
+			retx_retry( &retx[i] );
+		}
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*service_acks
+* Sends the ACKs / NAKs held for lack of tx fifo room, in order, as far as
+*   there is room for them now
+* INPUT: None
+* RETURN: None
+*/
+static void service_acks( void )
+{
+	struct TPacket_Data tx_data;
+	uint8_t held[2];
+	uint8_t tx_buff[MIN_PACKET_LENGTH + 1];
+	uint16_t tx_length;
+
+	while( ring_count( &ack_ring ) > 0 )
+	{
+		ring_peek( &ack_ring, 0, held );
+
+		tx_data.command   = held[0];
+		tx_data.ack       = held[1];
+		tx_data.data_size = 0;
+
+		tx_length = pack_tx_packet( tx_data, tx_buff );
+
+		if( uart_putp_resend( tx_buff, tx_length ) == FALSE )
+		{
+			break;
+		}
+
+		ring_release( &ack_ring, 1 );
+	}
+
+	return;
+}
+//============================================================================
+
+
+
+/*send_ready_for_pixel
+* Requests the next burn command and returns. The request is resent until the
+*   Pi acknowledges it (or sends the next burn), and the burn is halted once
+*   MAX_ATTEMPTS have gone unanswered
+* INPUT: None
+* RETURN: None
+*/
 void send_ready_for_pixel( void )
 {
 	struct TPacket_Data tx_data;
@@ -706,34 +1106,142 @@ void send_ready_for_pixel( void )
 	tx_data.ack = NEW_CMD;
 	tx_data.data_size = 0;					// No payload
 
-	uint8_t tx_buff[MIN_PACKET_LENGTH];		// Minimum packet length (STX, CMD, ETX)
-	uint16_t tx_length = pack_tx_packet( tx_data, tx_buff );
+	// If connection with the Pi is lost, halt the burn
+	retx_send( RETX_READY, &tx_data, MAX_ATTEMPTS, halt_burn );
+
+	// The next burn command must arrive within the timeout
+	pixel_request_time = time_ms;
+
+	return;
+}
+//============================================================================
+
 
-	uint16_t i = 0;
-	struct TPacket_Data rx_data;
-	rx_data.ack = 0;
-	rx_data.command = 0;
 
-	// Attempt to send the message several times, waiting for the correct response
-	//   (acknowledgement and ready command)
-	while( i < MAX_ATTEMPTS && !( rx_data.ack == ACK_MSG && rx_data.command == tx_data.command ) )
+/*service_pixel_request
+* Requests the next pixel as soon as a burn command has been taken and the
+*   burn queue has room for another, rather than once it has been burned, so
+*   the Pi's next command arrives while this one is still moving or burning
+* INPUT: None
+* RETURN: None
+*/
+void service_pixel_request( void )
+{
+	if( ready_owed == TRUE && picture_ip == TRUE && burn_queue_free() > 0 )
 	{
-		uart_putp( tx_buff, tx_length );
-		check_and_respond_to_msg( &rx_data );
+		ready_owed = FALSE;
+		send_ready_for_pixel();
+	}
 
-		i++;
+	return;
+}
+//============================================================================
+
+
+
+/*service_end_request
+* Finishes the picture once a pending CMD_END has no burns left ahead of it
+* INPUT: None
+* RETURN: None
+*/
+void service_end_request( void )
+{
+	if( end_pending == FALSE || burn_busy() == TRUE )
+	{
+		return;
 	}
 
-	// If connection with the Pi is lost, halt the burn
-	if( !( rx_data.ack == ACK_MSG && rx_data.command == tx_data.command ) )
+	end_pending = FALSE;
+
+	cancel_vector();		// In case the last pixel asked to keep the laser on
+	disable_laser();
+	picture_ip = FALSE;
+
+	home_pending = TRUE;
+	door_opened = FALSE;
+
+	return;
+}
+//============================================================================
+
+
+
+/*service_start_request
+* Answers a pending CMD_START (or CMD_JOB_RUN) once the lid is closed and has
+*   been opened since the last picture (door_opened is set by the lid interlock).
+*   A CMD_RESUME only waits on the lid being closed, as the work hasn't moved
+* INPUT: None
+* RETURN: None
+*/
+void service_start_request( void )
+{
+	if( start_pending == FALSE || lid_open == TRUE || ( door_opened == FALSE && start_cmd != CMD_RESUME ) )
 	{
-		halt_burn();
+		return;
 	}
-	else
+
+	start_pending = FALSE;
+	end_pending   = FALSE;
+	ready_owed    = FALSE;
+
+	send_ack( start_cmd, ACK_MSG );
+
+	// The lid is closed - starting the picture releases the interlock
+	lid_resume();
+
+	picture_ip = TRUE;
+	first_pixel = TRUE;
+	clear_burn_queue();
+	code_stop();
+
+	if( start_cmd != CMD_RESUME ) { burns_done = 0; }
+	picture_halted = FALSE;
+	retx[RETX_PROGRESS].active = FALSE;
+
+	// The first burn waits on the homing
+	home_pending = TRUE;
+
+	if( start_cmd == CMD_JOB_RUN )
 	{
-		pixel_request_time = time_ms;
+		job_start();
 	}
 
+	return;
+}
+//============================================================================
+
+
+
+/*comm_task
+* Scheduler task for the Pi link - handles every packet waiting in the rx fifo,
+*   and sends what is owed to the Pi
+* INPUT: None
+* RETURN: None
+*/
+void comm_task( void )
+{
+	do
+	{
+		check_and_respond_to_msg( 0 );
+	} while( uart_packets_ready() > 0 );
+
+	service_acks();
+	service_dump();
+	service_retransmits();
+
+	service_end_request();
+	service_start_request();
+
+	if( pi_init == JUST_INITIALIZED )
+	{
+		// Indicate to the Pi that everything has been initialized
+		//send_MSP_initialized();
+
+		// Tell a reconnecting Pi where its picture got to
+		if( picture_halted == TRUE ) { send_progress(); }
+
+		pi_init = TRUE;	// Pi is initialized, and ping has been sent
+	}
 
 	return;
 }
@@ -741,6 +1249,12 @@ void send_ready_for_pixel( void )
 
 
 
+/*send_MSP_initialized
+* Tells the Pi the MSP is initialized. Since the MSP can't do anything until
+*   communication is initialized, it is resent until the Pi acknowledges it
+* INPUT: None
+* RETURN: None
+*/
 void send_MSP_initialized( void )
 {
 	struct TPacket_Data tx_data;
@@ -748,22 +1262,34 @@ void send_MSP_initialized( void )
 	tx_data.ack = NEW_CMD;
 	tx_data.data_size = 0;					// No payload
 
-	uint8_t tx_buff[MIN_PACKET_LENGTH];		// Minimum packet length (STX, CMD, ETX)
-	uint16_t tx_length = pack_tx_packet( tx_data, tx_buff );
+	retx_send( RETX_INIT, &tx_data, RETX_FOREVER, 0 );
+
+	return;
+}
+//============================================================================
 
-	struct TPacket_Data rx_data;
-	rx_data.ack = 0;
-	rx_data.command = 0;
 
-	// Since the MSP can't do anything until communication is initialized, 
-	//   attempt to send the message until the correct response is received
-	//   (acknowledgement and ready command)
-	while( !( rx_data.ack == ACK_MSG && rx_data.command == tx_data.command ) )
-	{
-		uart_putp( tx_buff, tx_length );
-		check_and_respond_to_msg( &rx_data );
-	}
 
+/*send_progress
+* Tells the Pi how many burn commands of the halted picture were finished, so
+*   it can carry on from there with CMD_RESUME
+* INPUT: None
+* RETURN: None
+*/
+void send_progress( void )
+{
+	struct TPacket_Data tx_data;
+	tx_data.command = CMD_PROGRESS;
+	tx_data.ack = NEW_CMD;
+	tx_data.data_size = CMD_PROGRESS_PAYLOAD_SIZE;
+
+	// Data stored with LSB first
+	tx_data.data[0] = (uint8_t)( burns_done       );
+	tx_data.data[1] = (uint8_t)( burns_done >> 8  );
+	tx_data.data[2] = (uint8_t)( burns_done >> 16 );
+	tx_data.data[3] = (uint8_t)( burns_done >> 24 );
+
+	retx_send( RETX_PROGRESS, &tx_data, MAX_ATTEMPTS, 0 );
 
 	return;
 }
@@ -771,6 +1297,12 @@ void send_MSP_initialized( void )
 
 
 
+/*send_burn_stop
+* Tells the Pi the burn has to stop. Since this implies failure, it is resent
+*   until the Pi acknowledges it
+* INPUT: None
+* RETURN: None
+*/
 void send_burn_stop( void )
 {
 	struct TPacket_Data tx_data;
@@ -778,23 +1310,142 @@ void send_burn_stop( void )
 	tx_data.ack = NEW_CMD;
 	tx_data.data_size = 0;					// No payload
 
-	uint8_t tx_buff[MIN_PACKET_LENGTH];		// Minimum packet length (STX, CMD, ETX)
-	uint16_t tx_length = pack_tx_packet( tx_data, tx_buff );
+	retx_send( RETX_EMERGENCY, &tx_data, RETX_FOREVER, 0 );
 
-	struct TPacket_Data rx_data;
-	rx_data.ack = 0;
-	rx_data.command = 0;
+	return;
+}
+//============================================================================
 
 
-	// Attempt to send the message, waiting for the correct response
-	//   (acknowledgement and burn stop command)
-	//	 Since this implies failure, keep sending indefinitely
-	while( !( rx_data.ack == ACK_MSG && rx_data.command == CMD_EMERGENCY ) )
+
+/*start_dump
+* Starts streaming a dump to the Pi (the burn trace, the statistics or the
+*   profile). service_dump() sends it a packet at a time, so the rest of the
+*   link is answered meanwhile
+* INPUT: DUMP_x type of the dump, and TRUE to reset the table once it is sent
+* RETURN: TRUE if started, FALSE if a dump is already being sent
+*/
+static uint8_t start_dump( uint8_t type, uint8_t reset )
+{
+	if( dump_type != DUMP_NONE )
 	{
-		uart_putp( tx_buff, tx_length );
-		check_and_respond_to_msg( &rx_data );
+		return FALSE;
 	}
 
+	dump_type  = type;
+	dump_reset = reset;
+
+	if( type == DUMP_TRACE )
+	{
+		// Oldest event first. Events burned meanwhile may overwrite the oldest
+		//   ones not sent yet, those are sent as they are then
+		dump_next = burn_trace_head - burn_trace_count;
+		dump_end  = burn_trace_head;
+	}
+	else
+	{
+		dump_next = 0;
+		dump_end  = ( type == DUMP_STATS ) ? STATS_COUNT : PROF_COUNT * PROF_FIELDS;
+	}
+
+	return TRUE;
+}
+//============================================================================
+
+
+
+/*service_dump
+* Sends the next packet of the dump in progress if the tx fifo has room for it:
+*   one packet per value followed by the end command. The ACKs / NAKs held for
+*   room go first. Dump packets are not acknowledged by the Pi.
+* INPUT: None
+* RETURN: None
+*/
+static void service_dump( void )
+{
+	struct TPacket_Data tx_data;
+	uint8_t tx_buff[MAX_PACKET_LENGTH];
+	uint16_t tx_length;
+	uint32_t value;
+	struct TBurn_Event * event;
+
+	if( dump_type == DUMP_NONE || ring_count( &ack_ring ) > 0 )
+	{
+		return;
+	}
+
+	tx_data.ack = NEW_CMD;
+
+	if( dump_next != dump_end && dump_type == DUMP_TRACE )
+	{
+		event = &burn_trace[ dump_next & ( TRACE_SIZE - 1 ) ];
+
+		// LSB first in the data field (sent MSB first)
+		tx_data.command   = CMD_TRACE;
+		tx_data.data_size = CMD_TRACE_EVENT_SIZE;
+		tx_data.data[0] = (uint8_t)( event->time );
+		tx_data.data[1] = (uint8_t)( event->time >> 8 );
+		tx_data.data[2] = (uint8_t)( event->x );
+		tx_data.data[3] = (uint8_t)( event->x >> 8 );
+		tx_data.data[4] = (uint8_t)( event->y );
+		tx_data.data[5] = (uint8_t)( event->y >> 8 );
+		tx_data.data[6] = (uint8_t)( event->duration );
+		tx_data.data[7] = (uint8_t)( event->duration >> 8 );
+	}
+	else if( dump_next != dump_end )
+	{
+#ifdef PROFILE
+		value = ( dump_type == DUMP_STATS ) ? stats_get( dump_next ) : prof_get( dump_next );
+		tx_data.command = ( dump_type == DUMP_STATS ) ? CMD_STATS : CMD_PROFILE;
+#else
+		value = stats_get( dump_next );
+		tx_data.command = CMD_STATS;
+#endif
+
+		// LSB first in the data field (sent MSB first)
+		tx_data.data_size = CMD_STATS_VALUE_SIZE;
+		tx_data.data[0] = (uint8_t)( value );
+		tx_data.data[1] = (uint8_t)( value >> 8 );
+		tx_data.data[2] = (uint8_t)( value >> 16 );
+		tx_data.data[3] = (uint8_t)( value >> 24 );
+		tx_data.data[4] = (uint8_t)dump_next;
+	}
+	else if( dump_type == DUMP_TRACE )
+	{
+		tx_data.command   = CMD_TRACE_END;
+		tx_data.data_size = CMD_TRACE_END_PAYLOAD_SIZE;
+	}
+	else
+	{
+#ifdef PROFILE
+		tx_data.command = ( dump_type == DUMP_STATS ) ? CMD_STATS_END : CMD_PROFILE_END;
+#else
+		tx_data.command = CMD_STATS_END;
+#endif
+		tx_data.data_size = CMD_STATS_END_PAYLOAD_SIZE;
+	}
+
+	// Waiting on room isn't counted as a tx overrun
+	tx_length = pack_tx_packet( tx_data, tx_buff );
+	if( uart_putp_resend( tx_buff, tx_length ) == FALSE )
+	{
+		return;
+	}
+
+	if( dump_next != dump_end )
+	{
+		dump_next++;
+		return;
+	}
+
+	// Start counting afresh, so the next read covers only what follows
+	if( dump_reset == TRUE && dump_type == DUMP_STATS ) { stats_reset(); }
+#ifdef PROFILE
+	if( dump_reset == TRUE && dump_type == DUMP_PROFILE ) { prof_reset(); }
+#endif
+
+	dump_type = DUMP_NONE;
+
 	return;
 }
 //============================================================================
@@ -808,9 +1459,20 @@ void send_ack( uint8_t command, uint8_t ack )
 	tx_data.ack = ack;
 	tx_data.data_size = 0;
 
+	if( ack == NAK_MSG ) { stats[STAT_NAKS_SENT]++; }
+
 	uint8_t tx_buff[MIN_PACKET_LENGTH + 1];
 	uint16_t tx_length = pack_tx_packet( tx_data, tx_buff );
-	uart_putp( tx_buff, tx_length );
+	uint8_t held[2];
+
+	// Behind any already held, so the Pi gets them in order. If the queue is
+	//   full as well it's dropped, and the Pi sends the command again
+	if( ring_count( &ack_ring ) > 0 || uart_putp( tx_buff, tx_length ) == FALSE )
+	{
+		held[0] = command;
+		held[1] = ack;
+		ring_push( &ack_ring, held );
+	}
 
 	return;
 }
@@ -824,64 +1486,95 @@ void send_ack( uint8_t command, uint8_t ack )
 __interrupt void USCI0RXTX_ISR(void)
 {
 	uint8_t UCA1IV_temp = UCA1IV;
+	uint8_t c;
+	PROF_ENTER( PROF_ISR_UART );
 
 	if(UCA1IV_temp & BIT1)
 	{
-		rx_char = UCA1RXBUF;				//Copy from RX buffer, in doing so we ACK the interrupt as well
-		rx_flag = 1;						//Set the rx_flag to 1
+		c = UCA1RXBUF;						//Copy from RX buffer, in doing so we ACK the interrupt as well
+		rx_char = c;
 
-		rx_fifo[rx_fifo_ptB] = rx_char;		//Copy the rx_char into the fifo
-		rx_fifo_ptB++;
+		// Track escapes as they arrive, so an escaped STX / ETX in the payload is data
+		uint8_t escaped = rx_escape;
+		rx_escape = ( escaped == 0 && c == ESC ) ? 1 : 0;
 
-		if(rx_fifo_ptB == FIFO_SIZE)		//Roll the fifo pointer over
+		if( c == STX && escaped == 0 )
 		{
-			rx_fifo_ptB = 0;
-		}
+			if( packet_ip == RX_IN_FRAME )
+			{
+				// A new frame started before the last one ended - drop the partial one
+				rx_resyncs++;
+			}
 
-		if( rx_fifo_ptA == rx_fifo_ptB )		//fifo full
+			packet_ip     = RX_IN_FRAME;
+			rx_frame_size = 0;
+		}
+		else if( packet_ip == RX_IDLE )
 		{
-			rx_fifo_full = 1;
+			rx_escape = 0;
+			PROF_EXIT( PROF_ISR_UART );
+			return;							// Only frames are kept - anything between them is line noise
 		}
-		else
+		else if( packet_ip == RX_SKIP_FRAME )
 		{
-			rx_fifo_full = 0;
+			if( c == ETX && escaped == 0 ) { packet_ip = RX_IDLE; }
+			PROF_EXIT( PROF_ISR_UART );
+			return;							// Rest of a dropped frame
 		}
 
-		if( rx_char == STX && packet_ip == 0 )
+		if( ring_free( &rx_ring ) <= rx_frame_size || rx_frame_size >= MAX_PACKET_LENGTH )	//fifo full or frame too long
 		{
-			packet_ip = 1;
-
-			if( packet_ready == 1 )
-			{
-				// TODO: Account for case where two messages received at once
-			}
+			// Drop the whole frame rather than overwrite unread data (the Pi sends
+			//   it again when it goes unanswered), and skip the rest of it. No
+			//   packet is longer than MAX_PACKET_LENGTH, which keeps rx_frame_size
+			//   in its byte
+			packet_ip = ( c == ETX && escaped == 0 ) ? RX_IDLE : RX_SKIP_FRAME;
+			rx_overruns++;
+			PROF_EXIT( PROF_ISR_UART );
+			return;
 		}
-		else if( rx_char == ETX && packet_ip == 1)
+
+		ring_write( &rx_ring, rx_frame_size, &c );	//Copy the rx_char into the fifo
+		rx_frame_size++;
+
+		if( c == ETX && escaped == 0 )
 		{
-			uint16_t esc_count = 0;
-			while( rx_fifo[ ( rx_fifo_ptB - 1 ) - esc_count - 1 ] == ESC ) { esc_count++; }
+			packet_ip = RX_IDLE;
 
-			if( esc_count % 2 == 0 )
+			if( ring_free( &rx_frame_ring ) == 0 )
 			{
-				packet_ip 	 = 0;
-				packet_ready = 1;
+				// No room to record it - drop it as for a full fifo
+				rx_overruns++;
+				PROF_EXIT( PROF_ISR_UART );
+				return;
 			}
+
+			// Hand the frame to the main program, chars first
+			ring_commit( &rx_ring, rx_frame_size );
+			ring_push( &rx_frame_ring, &rx_frame_size );
+
+			POST_EVENT_FROM_ISR( EV_UART_RX );
 		}
 	}
 	else if(UCA1IV_temp & BIT2)
 	{
-		UCA1TXBUF = tx_fifo[tx_fifo_ptB];		//Copy the fifo into the TX buffer
-		tx_fifo_ptB++;
-
-		if(tx_fifo_ptB == FIFO_SIZE)			//Roll the fifo pointer over
+		if( ring_pop( &tx_ring, &c ) == FALSE )	//Emptied by the previous interrupt while the main program was queueing
 		{
-			tx_fifo_ptB = 0;
+			UCA1IFG |= BIT1;					//Reading UCA1IV cleared TXIFG - set it again so the next enable fires
+			UCA1IE &= ~(BIT1);
+			PROF_EXIT( PROF_ISR_UART );
+			return;
 		}
-		if(tx_fifo_ptB == tx_fifo_ptA)			//Fifo pointers the same no new data to transmit
+
+		UCA1TXBUF = c;					//Copy the fifo into the TX buffer
+
+		if( ring_count( &tx_ring ) == 0 )		//No new data to transmit
 		{
 			UCA1IE &= ~(BIT1); 					//Turn off the interrupt to save CPU
 		}
 	}
+
+	PROF_EXIT( PROF_ISR_UART );
 }
 //============================================================================
 
@@ -34,49 +34,38 @@ struct TPacket_Data
 ////////////////////////////////////////////////////////////////////////////////
 
 
-/*rx_flag
-* This flag is to be used by other modules to check and see if a new transmission has happened.
-* This is READ ONLY. Do not write to it or the UART may crash.
-*/
-extern volatile uint8_t rx_flag;
-
-/*rx_fifo_full
-* This flag is to be used by other modules to check and see if the rx fifo is full.
-* This is READ ONLY. Do not write to it or the UART may crash.
-*/
-extern volatile uint8_t rx_fifo_full;
-
-/*tx_fifo_full
-* This flag is to be used by other modules to check and see if the rx fifo is full.
-* This is READ ONLY. Do not write to it or the UART may crash.
-*/
-extern volatile uint8_t tx_fifo_full;
-
-////////////////////////////////////////////////////////////////////////////////
-
-
 void init_uart( void );
 
 uint8_t uart_getc();
+uint16_t uart_packets_ready( void );
 void uart_gets( char* Array, uint16_t length );
 uint16_t uart_getp( uint8_t* packet, uint16_t max_length );
-void uart_putc( uint8_t c);
+uint16_t uart_tx_free( void );
+uint8_t uart_putc( uint8_t c);
 void uart_puts( char *str);
-void uart_putp( uint8_t *packet, uint16_t length);
+uint8_t uart_putp( uint8_t *packet, uint16_t length);
 
 uint16_t parse_rx_packet( uint8_t *rx_buff, uint16_t length, struct TPacket_Data * rx_data );
 uint16_t pack_tx_packet( struct TPacket_Data tx_data, uint8_t * tx_buff );
 void parse_burn_cmd_payload( uint8_t * burn_cmd_payload,
 							 uint32_t * yLocation,
 							 uint32_t * xLocation,
-							 uint32_t * laserInt );
+							 uint32_t * laserInt,
+							 uint8_t  * keepOn,
+							 uint8_t  * dither );
 
 uint8_t calc_8bit_mod_checksum( uint8_t *data, uint16_t length );
 
 void check_and_respond_to_msg( struct TPacket_Data * rx_data );
+void comm_task( void );
 void send_ready_for_pixel( void );
+void service_pixel_request( void );
+void service_end_request( void );
+void service_start_request( void );
 void send_MSP_initialized( void );
+void send_progress       ( void );
 void send_burn_stop      ( void );
+void uart_flush( void );
 
 void send_ack( uint8_t command, uint8_t ack );
 
@@ -0,0 +1,315 @@
+#!/usr/bin/env python
+# Flash/RAM budget report for the MSP430 build.
+#
+# Reads the linker map (memory configuration) and the link info XML written
+# by CCS (one entry per linked section piece) and prints:
+#   - used/free bytes per memory region
+#   - flash and RAM per module (our objects and runtime library members)
+#   - the largest functions
+#   - runtime library pieces dragged in by double/float math, libm or stdio
+#   - the change against the committed baseline
+#   - the RAM outside the pools against RAM_OTHER_SIZE in defs.h
+#
+# Run after a CCS build:
+#   python mapBudget.py                 report and diff against the baseline
+#   python mapBudget.py --update        rewrite the baseline from this build
+#   python mapBudget.py --fail-over 256 exit 1 if flash or RAM grew > 256 B
+# It also exits 1 if the memory plan in defs.h doesn't cover the link
+from __future__ import print_function
+
+import argparse
+import os
+import re
+import sys
+import xml.etree.ElementTree as ET
+
+EMBEDDED_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'Laser_Engraver_Embedded')
+MAP_FILE = os.path.join(EMBEDDED_DIR, 'Debug', 'Laser_Engraver.map')
+XML_FILE = os.path.join(EMBEDDED_DIR, 'Debug', 'Laser_Engraver_linkInfo.xml')
+BASELINE_FILE = os.path.join(EMBEDDED_DIR, 'budget_baseline.txt')
+DEFS_FILE = os.path.join(EMBEDDED_DIR, 'defs.h')
+
+TOP_FUNCTIONS = 15
+
+# Runtime library members that only show up when the code uses them.
+# Soft-float: every double/float operation on the MSP430 is a library call.
+SOFT_FLOAT = re.compile(r'^(addd|subd|mpyd|divd|cmpd|negd|renormd|frc\w+|fix[df]\w*|flt\w*[df]|'
+                        r'addf|subf|mpyf|divf|cmpf|negf|renormf|cvtdf|cvtfd)\.obj$')
+LIBMATH = re.compile(r'^(sqrtf?|powf?|expf?|logf?|log10f?|sinf?|cosf?|tanf?|asinf?|acosf?|atanf?|atan2f?|'
+                     r'floorf?|ceilf?|fabsf?|fmodf?|modff?|ldexpf?|frexpf?|roundf?)\.obj$')
+STDIO = re.compile(r'^(printf|sprintf|_printfi\w*|fputc|fputs|fflush|fseek|fopen|fclose|setvbuf|'
+                   r'remove|lowlev|trgdrv|trgmsg|_io_perm|memory)\.obj$')
+
+
+def parseMemory(mapFile):
+    # Returns [(name, origin, length, used)] from the MEMORY CONFIGURATION table
+    regions = []
+    inTable = False
+    for line in open(mapFile):
+        if line.startswith('MEMORY CONFIGURATION'):
+            inTable = True
+            continue
+        if not inTable:
+            continue
+        if line.startswith('SECTION ALLOCATION MAP'):
+            break
+        fields = line.split()
+        if len(fields) >= 5 and re.match(r'^[0-9a-fA-F]{8}$', fields[1]):
+            regions.append((fields[0], int(fields[1], 16), int(fields[2], 16), int(fields[3], 16)))
+    return regions
+
+
+def regionOf(regions, address):
+    for name, origin, length, used in regions:
+        if origin <= address < origin + length:
+            return name
+    return None
+
+
+def isRam(region):
+    return region is not None and 'RAM' in region
+
+
+def commonOwners(sourceDir):
+    # .common symbols (uninitialized globals) carry no input file in the link
+    # info, so find the C file that defines each one at file scope instead
+    owners = {}
+    definition = re.compile(r'^(?!extern\b)[A-Za-z_][\w \*]*?\b(\w+)\s*(\[[^\]]*\]\s*)*(=[^;]*)?;')
+    for name in sorted(os.listdir(sourceDir)):
+        if not name.endswith('.c'):
+            continue
+        for line in open(os.path.join(sourceDir, name)):
+            m = definition.match(line)
+            if m and m.group(1) not in owners:
+                owners[m.group(1)] = name[:-2] + '.obj'
+    return owners
+
+
+def parseComponents(xmlFile, regions, owners):
+    # Returns [(module, section, flash, ram, libraryMember)] for every piece
+    # placed in memory (debug sections are not loaded and are skipped)
+    root = ET.parse(xmlFile).getroot()
+    files = {}
+    for f in root.iter('input_file'):
+        archive = f.findtext('kind') == 'archive'
+        files[f.get('id')] = (f.findtext('name'), archive)
+
+    components = []
+    for oc in root.iter('object_component'):
+        section = oc.findtext('name')
+        address = oc.findtext('run_address')
+        size = oc.findtext('size')
+        if section is None or address is None or size is None or section.startswith('.debug'):
+            continue
+        size = int(size, 16)
+        if size == 0:
+            continue
+        ref = oc.find('input_file_ref')
+        if ref is not None and ref.get('idref') in files:
+            module, archive = files[ref.get('idref')]
+        elif section.startswith('.common:'):
+            module, archive = owners.get(section[len('.common:'):], '(common)'), False
+        else:
+            module, archive = '(linker)', False
+        if isRam(regionOf(regions, int(address, 16))):
+            components.append((module, section, 0, size, archive))
+        else:
+            components.append((module, section, size, 0, archive))
+    return components
+
+
+def moduleTotals(components):
+    totals = {}
+    for module, section, flash, ram, archive in components:
+        key = ('lib' if archive else 'obj', module)
+        f, r = totals.get(key, (0, 0))
+        totals[key] = (f + flash, r + ram)
+    return totals
+
+
+def functionSizes(components):
+    sizes = {}
+    for module, section, flash, ram, archive in components:
+        if section.startswith('.text:'):
+            key = ('fn', section[len('.text:'):])
+            f, r = sizes.get(key, (0, 0))
+            sizes[key] = (f + flash, r)
+    return sizes
+
+
+def readBaseline(path):
+    # Lines of "kind name flash ram"; '#' starts a comment
+    baseline = {}
+    if not os.path.exists(path):
+        return None
+    for line in open(path):
+        fields = line.split('#')[0].split()
+        if len(fields) == 4:
+            baseline[(fields[0], fields[1])] = (int(fields[2]), int(fields[3]))
+    return baseline
+
+
+def writeBaseline(path, entries):
+    out = open(path, 'w')
+    out.write('# Flash/RAM baseline written by mapBudget.py --update\n')
+    out.write('# kind name flash ram\n')
+    for key in sorted(entries):
+        out.write('%s %s %d %d\n' % (key[0], key[1], entries[key][0], entries[key][1]))
+    out.close()
+
+
+def printRegions(regions):
+    print('Memory regions')
+    print('  %-12s %8s %8s %8s %6s' % ('region', 'size', 'used', 'free', 'used%'))
+    for name, origin, length, used in regions:
+        if 'RAM' not in name and 'FLASH' not in name:
+            continue
+        print('  %-12s %8d %8d %8d %5d%%' % (name, length, used, length - used, 100 * used // length))
+    print()
+
+
+def printModules(totals):
+    print('Per module (bytes)')
+    print('  %-28s %8s %8s' % ('module', 'flash', 'ram'))
+    keys = sorted(totals, key=lambda k: (k[0] == 'lib', -(totals[k][0] + totals[k][1]), k[1]))
+    for key in keys:
+        name = key[1] if key[0] == 'obj' else 'rts:' + key[1]
+        print('  %-28s %8d %8d' % (name, totals[key][0], totals[key][1]))
+    ours = [totals[k] for k in totals if k[0] == 'obj']
+    libs = [totals[k] for k in totals if k[0] == 'lib']
+    print('  %-28s %8d %8d' % ('total (ours)', sum(t[0] for t in ours), sum(t[1] for t in ours)))
+    print('  %-28s %8d %8d' % ('total (runtime lib)', sum(t[0] for t in libs), sum(t[1] for t in libs)))
+    print()
+
+
+def printFunctions(sizes):
+    print('Largest functions (flash bytes)')
+    for key in sorted(sizes, key=lambda k: -sizes[k][0])[:TOP_FUNCTIONS]:
+        print('  %-36s %8d' % (key[1], sizes[key][0]))
+    print()
+
+
+def printPulls(totals):
+    groups = [('soft-float (double/float math)', SOFT_FLOAT),
+              ('libmath', LIBMATH),
+              ('stdio (printf and friends)', STDIO)]
+    print('Runtime library pulls')
+    for title, pattern in groups:
+        hits = [(k[1], totals[k][0] + totals[k][1]) for k in totals if k[0] == 'lib' and pattern.match(k[1])]
+        if not hits:
+            print('  %-32s none' % title)
+            continue
+        print('  %-32s %d bytes in %d members: %s' % (title, sum(h[1] for h in hits), len(hits),
+                                                      ', '.join(sorted(h[0][:-4] for h in hits))))
+    print()
+
+
+def readDefines(path):
+    # Returns the #defines of defs.h by name, as their (unexpanded) values
+    defines = {}
+    text = open(path).read().replace('\\\n', ' ')
+    for m in re.finditer(r'^#define\s+(\w+)\s+(.*)$', text, re.M):
+        defines[m.group(1)] = m.group(2).split('//')[0].strip()
+    return defines
+
+
+def defineValue(defines, name):
+    # Works out a define made of numbers, other defines and integer arithmetic
+    expr = re.sub(r'\b(0x[0-9a-fA-F]+|\d+)[uUlL]*\b', r'\1', defines[name])
+    expr = re.sub(r'\b[A-Za-z_]\w*\b', lambda m: '(%d)' % defineValue(defines, m.group(0)), expr)
+    return eval(expr.replace('/', '//'), {'__builtins__': {}})
+
+
+def printRamPlan(components, defines):
+    # Checks the memory plan against the link: everything in RAM but the
+    # stack and heap must fit in the pools plus RAM_OTHER_SIZE.
+    # Returns True if it does
+    linked = sum(c[3] for c in components if c[1] not in ('.stack', '.sysmem'))
+    pools = defineValue(defines, 'RAM_POOLS_SIZE')
+    other = defineValue(defines, 'RAM_OTHER_SIZE')
+    print('RAM plan (defs.h)')
+    print('  %-28s %8d' % ('linked, less stack and heap', linked))
+    print('  %-28s %8d' % ('pools (RAM_POOLS_SIZE)', pools))
+    print('  %-28s %8d' % ('outside the pools', linked - pools))
+    print('  %-28s %8d' % ('RAM_OTHER_SIZE', other))
+    if linked - pools > other:
+        print('  RAM_OTHER_SIZE is too small - raise it to at least %d' % (linked - pools))
+        print()
+        return False
+    print()
+    return True
+
+
+def printDiff(baseline, entries):
+    # Returns the total (flash, ram) growth against the baseline
+    print('Against baseline')
+    if baseline is None:
+        print('  no baseline (run with --update to write one)')
+        print()
+        return (0, 0)
+    changes = []
+    for key in sorted(set(baseline) | set(entries)):
+        old = baseline.get(key, (0, 0))
+        new = entries.get(key, (0, 0))
+        if old != new:
+            changes.append((key, old, new))
+    for key, old, new in changes:
+        if key not in baseline:
+            note = ' (new)'
+        elif key not in entries:
+            note = ' (gone)'
+        else:
+            note = ''
+        print('  %-4s %-30s flash %+6d  ram %+6d%s' % (key[0], key[1], new[0] - old[0], new[1] - old[1], note))
+    if not changes:
+        print('  no change')
+    # Functions are already counted in their module, so total over modules only
+    grow = [0, 0]
+    for key, old, new in changes:
+        if key[0] != 'fn':
+            grow[0] += new[0] - old[0]
+            grow[1] += new[1] - old[1]
+    print('  %-35s flash %+6d  ram %+6d' % ('total', grow[0], grow[1]))
+    print()
+    return tuple(grow)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Flash/RAM budget report from the CCS link output')
+    parser.add_argument('--map', default=MAP_FILE, help='linker map file')
+    parser.add_argument('--xml', default=XML_FILE, help='link info XML file')
+    parser.add_argument('--baseline', default=BASELINE_FILE, help='baseline to diff against')
+    parser.add_argument('--update', action='store_true', help='rewrite the baseline from this build')
+    parser.add_argument('--fail-over', type=int, default=None, metavar='BYTES',
+                        help='exit 1 if flash or RAM grew by more than BYTES against the baseline')
+    args = parser.parse_args()
+
+    regions = parseMemory(args.map)
+    components = parseComponents(args.xml, regions, commonOwners(EMBEDDED_DIR))
+    totals = moduleTotals(components)
+    sizes = functionSizes(components)
+    entries = dict(totals)
+    entries.update(sizes)
+
+    printRegions(regions)
+    printModules(totals)
+    printFunctions(sizes)
+    printPulls(totals)
+    planOk = printRamPlan(components, readDefines(DEFS_FILE))
+
+    if args.update:
+        writeBaseline(args.baseline, entries)
+        print('Baseline written to', args.baseline)
+        return 0
+
+    grow = printDiff(readBaseline(args.baseline), entries)
+    if args.fail_over is not None and max(grow) > args.fail_over:
+        print('Budget exceeded: grew by more than %d bytes' % args.fail_over)
+        return 1
+    if not planOk:
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -57,9 +57,51 @@ burn 	= 0x0B
 emerg	= 0x0d
 endIm	= 0x0F
 startIm	= 0x11
+resume	= 0x13
 esc 	= 0x1B
 error	= 0x3f
 readyB 	= 0x4d
+trace	= 0x21
+traceEnd= 0x23
+progress= 0x25
+stats	= 0x27
+statsEnd= 0x29
+profile	= 0x2B
+profileEnd= 0x2D
+jobBegin= 0x31
+jobData	= 0x33
+jobEnd	= 0x35
+jobRun	= 0x37
+codeData= 0x39
+
+JOB_CHUNK	= 8		# Job bytes per jobData packet (JOB_CHUNK_SIZE)
+JOB_FORMAT_BURN	= 1		# Job records are burn payloads
+JOB_FORMAT_RASTER = 2		# Compressed raster (ImageProcessing.rasterJob)
+JOB_FORMAT_CODE	= 3		# Bytecode program (codeMove etc.)
+JOB_DATA_MAX	= 0xFFF0	# Most job bytes the MSP's flash holds
+CODE_CHUNK	= 8		# Program bytes per codeData packet (CODE_CHUNK_SIZE)
+
+# Statistics counters, by their id (STAT_x in defs.h)
+STAT_NAMES = ["rxPackets", "rxErrors", "rxOverruns", "rxResyncs", "txOverruns",
+	      "naksSent", "naksReceived", "resends", "readyResends", "retxFailures",
+	      "pixelTimeouts", "halts", "burns", "commWaitMs", "motionMs", "burnMs"]
+
+# Profiled sections, by their id (PROF_x in defs.h), each sent as
+#   PROF_FIELDS values: runs, min, max, average (CPU cycles)
+PROF_NAMES = ["parseRx", "uartGetp", "parseBurn", "queueMove", "startLaser",
+	      "isrStep", "isrUart", "isrTick", "isrPort2"]
+PROF_FIELDS = 4
+SMCLK_HZ = 24576000
+
+# Bytecode opcodes (OP_x in defs.h)
+opEnd	= 0x00
+opMove	= 0x01
+opLine	= 0x02
+opRow	= 0x03
+opDwell	= 0x04
+opPower	= 0x05
+opRepeat= 0x06
+opNext	= 0x07
 
 startXc 	= "0x02"
 endXc 		= "0x03"
@@ -219,7 +261,8 @@ def sendX(ser, messages):
     return 0
 
 
-def receiveX(ser, expectations):
+def receiveX(ser, expectations, seen=None):
+    # seen (optional dict) is given every byte that arrived
     i = 0
     msgD = {}
     msgArray = []
@@ -240,6 +283,8 @@ def receiveX(ser, expectations):
 	    msgD[msg] = 1
 	    i = 0
 	    anything = True
+    if seen is not None:
+	seen.update(msgD)
     if (anything == False):
 	return 2
     for j in range(len(expectations)):
@@ -353,12 +398,12 @@ def logicFlow(ser, payload):
     sendX(ser, chr(endX))
     return 0
     
-def phase2(ser):
+def phase2(ser, seen=None):
     maxWait = 5
     reciv = 2 # This is the return val for no serial response
     startTime = time.time()
     while reciv == 2:
-	reciv = receiveX(ser, [chr(startX), chr(acknow), chr(burn), chr(endX)] )
+	reciv = receiveX(ser, [chr(startX), chr(acknow), chr(burn), chr(endX)], seen)
 	#if ((time.time() - startTime) > maxWait):
 	    # I've waited for 5 seconds, I give up
 	    #return 2 
@@ -393,11 +438,15 @@ def logicFlow2(ser, payload):
     startTime = time.time()
     
     p2 = 1
+    seen = {}
     while p2 == 1:
 	# Phase 1 0x02PAYCHECK03 Pi->MSP
         sendPix(ser, payload)
 	# Phase 2 0x02060b03 MSP->Pi
-	p2 = phase2(ser)
+	#   The MSP asks for the next pixel as soon as it has room, so the
+	#   ready (phase 3) can arrive right behind the ACK
+	seen.clear()
+	p2 = phase2(ser, seen)
         startTime = time.time()
 	if ((time.time() - startTime) > maxWait):
 	    print "P2 took too long"
@@ -408,6 +457,8 @@ def logicFlow2(ser, payload):
 
     # Phase 3 0x024d03  MSP<-Pi
     p3 = 1
+    if chr(readyB) in seen:
+	p3 = 0
     while p3 == 1:
 	p3 = phase3(ser)
         startTime = time.time()
@@ -425,6 +476,359 @@ def logicFlow2(ser, payload):
     sendX(ser, chr(endX))
     return 0
 
+def receiveFrame(ser):
+    # Reads one STX...ETX frame and returns the unescaped bytes between
+    #   them (ack/command, payload, checksum), None if the line goes quiet
+    frame = []
+    started = False
+    escaped = False
+    i = 0
+    while True:
+	try:
+	    msg = ser.read()
+	except serial.serialutil.SerialException:
+	    msg = ''
+	if (msg == ''):
+	    i += 1
+	    if (i >= 10):
+		return None
+	    continue
+	i = 0
+	c = ord(msg)
+	if (started == False):
+	    if (c == startX):
+		started = True
+	elif (escaped == True):
+	    frame.append(c)
+	    escaped = False
+	elif (c == esc):
+	    escaped = True
+	elif (c == endX):
+	    return frame
+	else:
+	    frame.append(c)
+
+def dumpTrace(ser):
+    # Asks the MSP for its burn trace (the last TRACE_SIZE burn commands)
+    #   Returns a list of (time ms, x, y, level, keepOn, duration ms),
+    #   oldest first. time is the low 16 bits of the MSP's ms counter. The
+    #   list is empty if the MSP refused the request (another dump going)
+    events = []
+    sendX(ser, chr(startX))
+    sendX(ser, chr(trace))
+    sendX(ser, chr(endX))
+    while True:
+	frame = receiveFrame(ser)
+	if (frame == None):
+	    print "Communication Lost"
+	    break
+	if (len(frame) == 0):
+	    continue
+	if (frame[0] == traceEnd):
+	    break
+	if (len(frame) == 2 and frame[0] == error and frame[1] == trace):
+	    return events
+	if ((frame[0] != trace) or (len(frame) != 10)):
+	    # ACK of the request, or something else we don't care about
+	    continue
+	# Payload comes MSB first: duration, y, x, time, then the checksum
+	payload = frame[1:9]
+	if (((sum(payload) + frame[9]) & 0xFF) != 0):
+	    print "Bad trace checksum\t", frame
+	    continue
+	duration = (payload[0] << 8) | payload[1]
+	yWord = (payload[2] << 8) | payload[3]
+	xWord = (payload[4] << 8) | payload[5]
+	stamp = (payload[6] << 8) | payload[7]
+	events.append((stamp, xWord & 0x1FFF, yWord & 0x1FFF, (yWord >> 13) & 0x03, xWord >> 15, duration))
+    return events
+
+def printTrace(events):
+    # Prints the trace with the gap between the start of each command
+    lastStamp = None
+    for e in events:
+	gap = 0
+	if (lastStamp != None):
+	    gap = (e[0] - lastStamp) & 0xFFFF
+	lastStamp = e[0]
+	print "t", e[0], "\tx", e[1], "\ty", e[2], "\tlev", e[3], "\ton", e[4], "\tdur", e[5], "\tgap", gap
+    if (len(events) > 0):
+	print "Average duration: ", sum(e[5] for e in events) / float(len(events)), " ms"
+    return
+
+def dumpTable(ser, command, endCommand, reset):
+    # Asks the MSP for a table of values (stats or profile), and to clear it
+    #   once sent if reset. Returns a dict of index -> value, or None if the
+    #   MSP refused the request (not built for it, or another dump going)
+    values = {}
+    sendFrame(ser, command, [1 if reset else 0])
+    while True:
+	frame = receiveFrame(ser)
+	if (frame == None):
+	    print "Communication Lost"
+	    break
+	if (len(frame) == 0):
+	    continue
+	if (frame[0] == endCommand):
+	    break
+	if (len(frame) == 2 and frame[0] == error and frame[1] == command):
+	    return None
+	if ((frame[0] != command) or (len(frame) != 7)):
+	    # ACK of the request, or something else we don't care about
+	    continue
+	# Payload comes MSB first: index, value, then the checksum
+	payload = frame[1:6]
+	if (((sum(payload) + frame[6]) & 0xFF) != 0):
+	    print "Bad table checksum\t", frame
+	    continue
+	values[payload[0]] = (payload[1] << 24) | (payload[2] << 16) | (payload[3] << 8) | payload[4]
+    return values
+
+def dumpStats(ser, reset=False):
+    # Reads the MSP's statistics counters. Returns a dict of name -> value
+    values = {}
+    table = dumpTable(ser, stats, statsEnd, reset)
+    if (table == None):
+	return values
+    for index in table:
+	if (index < len(STAT_NAMES)):
+	    values[STAT_NAMES[index]] = table[index]
+    return values
+
+def printStats(values):
+    # Prints the counters, and how the picture's time was spent
+    for name in STAT_NAMES:
+	if (name in values):
+	    print "%-16s %10d" % (name, values[name])
+    phases = ["commWaitMs", "motionMs", "burnMs"]
+    total = sum(values.get(p, 0) for p in phases)
+    if (total > 0):
+	for p in phases:
+	    print "%-16s %9.1f%%" % (p, 100.0 * values.get(p, 0) / total)
+    if (values.get("burns", 0) > 0):
+	print "Average per burn: ", total / float(values["burns"]), " ms"
+    return
+
+def dumpProfile(ser, reset=False):
+    # Reads the MSP's hot path profile. Returns a dict of section name ->
+    #   (runs, min, max, average) in CPU cycles, or None if the firmware
+    #   wasn't built with PROFILE
+    table = dumpTable(ser, profile, profileEnd, reset)
+    if (table == None):
+	return None
+    sections = {}
+    for i in range(len(PROF_NAMES)):
+	fields = [table.get(i * PROF_FIELDS + f, 0) for f in range(PROF_FIELDS)]
+	sections[PROF_NAMES[i]] = tuple(fields)
+    return sections
+
+def printProfile(sections):
+    if (sections == None):
+	print "Firmware not built with PROFILE"
+	return
+    print "%-14s %8s %10s %10s %10s %9s" % ("section", "runs", "min", "max", "avg", "avg us")
+    for name in PROF_NAMES:
+	runs, low, high, avg = sections[name]
+	if (runs > 0):
+	    print "%-14s %8d %10d %10d %10d %9.1f" % (name, runs, low, high, avg, avg * 1e6 / SMCLK_HZ)
+    return
+
+def sendFrame(ser, command, data):
+    # Sends a command with its payload. data is in the MSP's data[] order
+    #   (LSB first), the line carries it MSB first, escaped, with the checksum
+    specialChar = [startX, endX, esc]
+    msgA = [startX, command]
+    for b in reversed(data):
+	if (b in specialChar):
+	    msgA.append(esc)
+	msgA.append(b)
+    if (len(data) > 0):
+	checkSum = (256 - (sum(data) & 0xFF)) & 0xFF
+	if (checkSum in specialChar):
+	    msgA.append(esc)
+	msgA.append(checkSum)
+    msgA.append(endX)
+    return sendX(ser, "".join(chr(x) for x in msgA))
+
+def sendAndWait(ser, command, data, attempts=5):
+    # Sends a command until the MSP ACKs it. Returns 0 on ACK, 1 on NAK
+    #   (the MSP refused it), 2 if the MSP never answered
+    for attempt in range(attempts):
+	sendFrame(ser, command, data)
+	while True:
+	    frame = receiveFrame(ser)
+	    if (frame == None):
+		break
+	    if (len(frame) == 2 and frame[1] == command):
+		if (frame[0] == acknow):
+		    return 0
+		if (frame[0] == error):
+		    return 1
+    return 2
+
+def buildJobImage(q):
+    # Drains the queue of burn payloads into a job image: each 32-bit
+    #   payload LSB first, as the MSP holds it in data[]
+    image = []
+    while not q.empty():
+	payload = q.get()
+	for shift in (0, 8, 16, 24):
+	    image.append((payload >> shift) & 0xFF)
+	q.task_done()
+    return image
+
+def uploadJob(ser, image, format=JOB_FORMAT_BURN):
+    # Writes a job image to the MSP's flash, JOB_CHUNK bytes at a time.
+    #   Every chunk is verified by the MSP as it is written
+    #   Returns 0 once the MSP has checked the whole image, 1 on failure
+    if (len(image) > JOB_DATA_MAX):
+	print "Job too big for the MSP: ", len(image), " bytes"
+	return 1
+    if (sendAndWait(ser, jobBegin, []) != 0):
+	print "Job upload refused"
+	return 1
+    for index in range(0, (len(image) + JOB_CHUNK - 1) / JOB_CHUNK):
+	chunk = image[index * JOB_CHUNK:(index + 1) * JOB_CHUNK]
+	chunk = chunk + [0xFF] * (JOB_CHUNK - len(chunk))
+	if (sendAndWait(ser, jobData, [index & 0xFF, index >> 8] + chunk) != 0):
+	    print "Job upload failed at chunk", index
+	    return 1
+	if (index % 256 == 0):
+	    print "Uploaded", index * JOB_CHUNK, "of", len(image), "bytes"
+    length = len(image)
+    checkSum = sum(image) & 0xFFFF
+    end = [length & 0xFF, (length >> 8) & 0xFF, (length >> 16) & 0xFF, length >> 24,
+	   checkSum & 0xFF, checkSum >> 8, format & 0xFF, format >> 8]
+    if (sendAndWait(ser, jobEnd, end) != 0):
+	print "Job failed verification"
+	return 1
+    return 0
+
+def runJob(ser):
+    # Starts the job in flash. The MSP only answers once the lid has been
+    #   opened and closed, so keep waiting on it
+    print "Waiting on the lid to start the job"
+    while True:
+	reciv = sendAndWait(ser, jobRun, [], 1)
+	if (reciv != 2):
+	    return reciv
+
+def rpJobManager(q, ser, image=None, format=JOB_FORMAT_RASTER):
+    # Alternative to rpSerialManager: uploads the whole picture, then lets
+    #   the MSP burn it from flash with no per-pixel traffic. image is a
+    #   raster job from ImageProcessing.rasterJob or a program (format
+    #   JOB_FORMAT_CODE), else the burn payloads in the queue are sent as
+    #   they are
+    if (image == None):
+	image = buildJobImage(q)
+	format = JOB_FORMAT_BURN
+    print "Job image: ", len(image), " bytes"
+    if (uploadJob(ser, image, format) != 0):
+	return 1
+    if (runJob(ser) != 0):
+	print "Job refused"
+	return 1
+    print "DONE :P Job running from flash"
+    return 0
+
+def codeWord(value):
+    return [value & 0xFF, (value >> 8) & 0xFF]
+
+# Bytecode instructions - add them up into a program for sendProgram, or
+#   for rpJobManager with JOB_FORMAT_CODE. Coordinates are pixels
+def codeMove(x, y):
+    return [opMove] + codeWord(x) + codeWord(y)
+
+def codeLine(x, y):
+    # Line from where the head is, at the codePower level
+    return [opLine] + codeWord(x) + codeWord(y)
+
+def codeRow(pixels, backwards=False):
+    # Burns a row along x from where the head is, one pixel per entry,
+    #   burned where true. The head ends on the last pixel
+    count = len(pixels)
+    if (backwards):
+	count = -count
+    bits = [0] * ((len(pixels) + 7) / 8)
+    for i in range(len(pixels)):
+	if (pixels[i]):
+	    bits[i / 8] |= 1 << (i % 8)
+    return [opRow] + codeWord(count) + bits
+
+def codeDwell(ms):
+    return [opDwell] + codeWord(ms)
+
+def codePower(level):
+    return [opPower, level]
+
+def codeRepeat(n):
+    # Everything up to the matching codeNext runs n times
+    return [opRepeat] + codeWord(n)
+
+def codeNext():
+    return [opNext]
+
+def codeEnd():
+    return [opEnd]
+
+def sendProgram(ser, code):
+    # Streams a program to the MSP during a picture (after startIm). The
+    #   MSP refuses bytes until it has run enough of the program to hold
+    #   them, so keep offering them. Each chunk carries its index (low 8
+    #   bits), so one sent again after a lost ACK isn't taken twice.
+    #   Returns 0 once all are taken, 1 if the MSP stops answering
+    for start in range(0, len(code), CODE_CHUNK):
+	chunk = code[start:start + CODE_CHUNK]
+	index = start / CODE_CHUNK
+	data = [index & 0xFF, len(chunk)] + chunk + [0] * (CODE_CHUNK - len(chunk))
+	while True:
+	    reciv = sendAndWait(ser, codeData, data)
+	    if (reciv == 0):
+		break
+	    if (reciv == 2):
+		print "Program lost at byte", start
+		return 1
+	    time.sleep(0.05)
+    return 0
+
+def waitProgress(ser):
+    # After init, the MSP reports how far a halted picture got (it may home
+    #   first). Returns the number of burn commands it finished, or None if
+    #   it has no picture to resume
+    startTime = time.time()
+    while (time.time() - startTime) < 30:
+	frame = receiveFrame(ser)
+	if (frame != None and len(frame) == 6 and frame[0] == progress):
+	    sendX(ser, "".join(chr(x) for x in [startX, acknow, progress, endX]))
+	    return (frame[1] << 24) | (frame[2] << 16) | (frame[3] << 8) | frame[4]
+    return None
+
+def reconnect(ser):
+    # Re-initializes the MSP after the link was lost, and carries on the
+    #   picture it halted. Returns how many burn commands the MSP had
+    #   finished (the offset to send from), or None if it can't carry on
+    print "Reconnecting"
+    while (sendAndWait(ser, init, []) != 0):
+	time.sleep(1)
+    done = waitProgress(ser)
+    if (done == None):
+	print "Nothing to resume"
+	return None
+    print "Resuming after", done, "pixels, waiting on the lid"
+    while True:
+	reciv = sendAndWait(ser, resume, [], 1)
+	if (reciv == 0):
+	    return done
+	if (reciv == 1):
+	    return None
+
+def resumeAfterLid(ser):
+    # Releases the MSP's lid interlock once the lid has been closed again
+    #   after it was opened mid-picture (the MSP holds the burn until then).
+    #   Returns 0 once released, 1 while the lid is still open, 2 if the MSP
+    #   never answered
+    return sendAndWait(ser, resume, [])
+
 def coolDown(oldepoch, runTime, sleepTime):
     if time.time() - oldepoch > 60*runTime:
 	oldepoch = time.time()
@@ -453,23 +857,35 @@ def rpSerialManager(q, ser):
     sleepTime = 5
     runTime = 5
 
+    # Every payload of the picture is kept, so a lost link can be picked
+    #   back up from the last one the MSP finished
+    sent = []
+    nextPix = 0
+
     #ser.write("HEN")
     while (i < 5):
         time.sleep(0.1)
 	i += 1
-	while not q.empty():
-	    payload = q.get()
-	    check = logicFlow2(ser, payload)
+	while not q.empty() or nextPix < len(sent):
+	    if (nextPix == len(sent)):
+		sent.append(q.get())
+		q.task_done()
+	    check = logicFlow2(ser, sent[nextPix])
 	    #oldepoch = coolDown(oldepoch, runTime, sleepTime)
 	    if check == 1:
-		# Communictation lost, return error code 1: Comm Lost
-		return 1
+		done = reconnect(ser)
+		if (done == None):
+		    # Communictation lost, return error code 1: Comm Lost
+		    return 1
+		nextPix = min(done, len(sent))
+		continue
+	    nextPix += 1
 	    pixCount += 1
-	    q.task_done()
 	    print pixCount, q.qsize(), q.empty()
 	    i = 0
     print "********************* **********"
     print "DONE :P ", pixCount," ", pixCount/1200
+    printStats(dumpStats(ser, True))
     # for testing mode
     #sys.exit('s')
     return 0